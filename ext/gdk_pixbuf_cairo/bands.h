@@ -0,0 +1,76 @@
+/*
+ * Row band threads for the pixbuf/surface conversions
+ *
+ * A conversion hands convert_bands() a callback that converts rows y0..y1-1.
+ * Large images are split into bands: one thread is started per band but the
+ * first, which the calling thread converts itself before joining the others.
+ * Each band only writes its own rows, so bands need no locking.
+ *
+ * The threads only live for one conversion, so nothing is shared with the
+ * morandi_native thread pool and nothing has to be rebuilt after fork(). How
+ * many bands are used is set separately with GdkPixbufCairo.concurrency=.
+ */
+
+typedef void (*convert_band_func_t)(void *data, int y0, int y1);
+
+/* Rows of fewer pixels than this are converted on the calling thread; starting a thread costs more */
+#define CONVERT_MIN_BAND_PIXELS (256 * 1024)
+
+typedef struct {
+    convert_band_func_t func;
+    void *data;
+    int y0, y1;
+} convert_band_t;
+
+static int convert_concurrency = 1;
+
+static gpointer convert_run_band(gpointer data) {
+    convert_band_t *band = data;
+
+    band->func(band->data, band->y0, band->y1);
+    return NULL;
+}
+
+static void convert_set_concurrency(int concurrency) {
+    g_atomic_int_set(&convert_concurrency, concurrency);
+}
+
+static void convert_init(void) {
+    convert_concurrency = MAX((int) g_get_num_processors(), 1);
+}
+
+/* Calls func over rows 0..height-1 of a width pixel wide image, in bands on separate threads where worthwhile */
+static void convert_bands(int height, int width, convert_band_func_t func, void *data) {
+    convert_band_t *bands;
+    GThread **threads;
+    int n_bands, i;
+
+    n_bands = MIN(g_atomic_int_get(&convert_concurrency), height);
+    n_bands = (int) MIN((gint64) n_bands, ((gint64) width * height) / CONVERT_MIN_BAND_PIXELS);
+
+    if (n_bands <= 1) {
+        if (height > 0)
+            func(data, 0, height);
+        return;
+    }
+
+    bands = g_new(convert_band_t, n_bands);
+    threads = g_new(GThread *, n_bands);
+    for (i = 0; i < n_bands; i++) {
+        bands[i].func = func;
+        bands[i].data = data;
+        bands[i].y0 = (int) (((gint64) height * i) / n_bands);
+        bands[i].y1 = (int) (((gint64) height * (i + 1)) / n_bands);
+    }
+
+    for (i = 1; i < n_bands; i++)
+        threads[i] = g_thread_new("gdk_pixbuf_cairo", convert_run_band, &bands[i]);
+
+    convert_run_band(&bands[0]);
+
+    for (i = 1; i < n_bands; i++)
+        g_thread_join(threads[i]);
+
+    g_free(threads);
+    g_free(bands);
+}
@@ -15,9 +15,205 @@
 #include "rbgobject.h"
 #include "rb_cairo.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GDK_PIXBUF_CAIRO_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "bands.h"
+
 static VALUE mGdkPixbufCairo;
 void Init_gdk_pixbuf_cairo(void);
 
+/*
+ * Cairo stores a pixel as one native-endian 32 bit word, A << 24 | R << 16 |
+ * G << 8 | B, premultiplied by alpha. Rows are converted word by word, with
+ * SSE2 or NEON doing several pixels at once where available, and big images
+ * are split into row bands on the shared thread pool.
+ */
+typedef struct {
+    const guchar *s_pixels;
+    guchar *d_pixels;
+    int s_stride, d_stride, width;
+} convert_rows_t;
+
+/* Multiplies colour c by alpha a, rounding to nearest: exactly c * a / 255 */
+#define MULT(c, a, t) ((t) = (c) * (a) + 0x80, (((t) >> 8) + (t)) >> 8)
+
+/*
+ * (s * unmult_recip[a]) >> 16 equals s * 255 / a for every s and a below 256;
+ * the error term s * (ceil(255 * 65536 / a) * a - 255 * 65536) stays below
+ * 65536. Zero alpha gives zero rather than dividing by zero.
+ */
+static guint32 unmult_recip[256];
+
+static void unmult_init(void) {
+    guint32 a;
+
+    unmult_recip[0] = 0;
+    for (a = 1; a < 256; a++)
+        unmult_recip[a] = ((255 << 16) + a - 1) / a;
+}
+
+static void rgb_to_surface_row(guint32 *q, const guchar *p, int width) {
+    int i = 0;
+
+#ifdef GDK_PIXBUF_CAIRO_NEON
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(p + (i * 3));
+        uint8x16x4_t bgra = {{rgb.val[2], rgb.val[1], rgb.val[0], vdupq_n_u8(0xff)}};
+
+        vst4q_u8((guchar *) (q + i), bgra);
+    }
+#endif
+
+    for (; i < width; i++) {
+        const guchar *px = p + (i * 3);
+        q[i] = 0xff000000u | ((guint32) px[0] << 16) | ((guint32) px[1] << 8) | px[2];
+    }
+}
+
+static void rgba_to_surface_row(guint32 *q, const guchar *p, int width) {
+    int i = 0;
+    guint t1, t2, t3;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colour_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    /* Alpha is multiplied by 255, which MULT turns back into alpha */
+    const __m128i alpha_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i half = _mm_set1_epi16(0x80);
+
+    for (; i + 4 <= width; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *) (p + (i * 4)));
+        __m128i halves[2] = {_mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero)};
+        int k;
+
+        for (k = 0; k < 2; k++) {
+            __m128i v = halves[k];
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i bgra = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+            __m128i t;
+
+            alpha = _mm_or_si128(_mm_and_si128(alpha, colour_mask), alpha_one);
+            t = _mm_add_epi16(_mm_mullo_epi16(bgra, alpha), half);
+            halves[k] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+
+        _mm_storeu_si128((__m128i *) (q + i), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#elif defined(GDK_PIXBUF_CAIRO_NEON)
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x4_t rgba = vld4q_u8(p + (i * 4));
+        uint8x16x4_t bgra;
+        int c;
+
+        for (c = 0; c < 3; c++) {
+            uint16x8_t lo = vaddq_u16(vmull_u8(vget_low_u8(rgba.val[c]), vget_low_u8(rgba.val[3])), vdupq_n_u16(0x80));
+            uint16x8_t hi = vaddq_u16(vmull_u8(vget_high_u8(rgba.val[c]), vget_high_u8(rgba.val[3])), vdupq_n_u16(0x80));
+
+            bgra.val[2 - c] = vcombine_u8(vshrn_n_u16(vaddq_u16(lo, vshrq_n_u16(lo, 8)), 8),
+                                          vshrn_n_u16(vaddq_u16(hi, vshrq_n_u16(hi, 8)), 8));
+        }
+        bgra.val[3] = rgba.val[3];
+
+        vst4q_u8((guchar *) (q + i), bgra);
+    }
+#endif
+
+    for (; i < width; i++) {
+        const guchar *px = p + (i * 4);
+        guint a = px[3];
+
+        q[i] = ((guint32) a << 24) | (MULT(px[0], a, t1) << 16) | (MULT(px[1], a, t2) << 8) | MULT(px[2], a, t3);
+    }
+}
+
+static void surface_to_rgb_row(guchar *p, const guint32 *q, int width) {
+    int i = 0;
+
+#ifdef GDK_PIXBUF_CAIRO_NEON
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x4_t bgra = vld4q_u8((const guchar *) (q + i));
+        uint8x16x3_t rgb = {{bgra.val[2], bgra.val[1], bgra.val[0]}};
+
+        vst3q_u8(p + (i * 3), rgb);
+    }
+#endif
+
+    for (; i < width; i++) {
+        guint32 px = q[i];
+
+        p[(i * 3) + 0] = px >> 16;
+        p[(i * 3) + 1] = px >> 8;
+        p[(i * 3) + 2] = px;
+    }
+}
+
+static void surface_to_rgba_row(guchar *p, const guint32 *q, int width) {
+    int i;
+
+    for (i = 0; i < width; i++) {
+        guint32 px = q[i];
+        guint a = px >> 24;
+        guchar *dp = p + (i * 4);
+
+        if (a == 0xff) {
+            dp[0] = px >> 16;
+            dp[1] = px >> 8;
+            dp[2] = px;
+        } else {
+            guint32 recip = unmult_recip[a];
+
+            /* Colours above alpha are not valid premultiplied data; they wrap as the division did */
+            dp[0] = (((px >> 16) & 0xff) * recip) >> 16;
+            dp[1] = (((px >> 8) & 0xff) * recip) >> 16;
+            dp[2] = ((px & 0xff) * recip) >> 16;
+        }
+        dp[3] = a;
+    }
+}
+
+#undef MULT
+
+static void rgb_to_surface_band(void *data, int y0, int y1) {
+    convert_rows_t *rows = data;
+    int y;
+
+    for (y = y0; y < y1; y++)
+        rgb_to_surface_row((guint32 *) (rows->d_pixels + (y * rows->d_stride)), rows->s_pixels + (y * rows->s_stride),
+                           rows->width);
+}
+
+static void rgba_to_surface_band(void *data, int y0, int y1) {
+    convert_rows_t *rows = data;
+    int y;
+
+    for (y = y0; y < y1; y++)
+        rgba_to_surface_row((guint32 *) (rows->d_pixels + (y * rows->d_stride)), rows->s_pixels + (y * rows->s_stride),
+                            rows->width);
+}
+
+static void surface_to_rgb_band(void *data, int y0, int y1) {
+    convert_rows_t *rows = data;
+    int y;
+
+    for (y = y0; y < y1; y++)
+        surface_to_rgb_row(rows->d_pixels + (y * rows->d_stride),
+                           (const guint32 *) (rows->s_pixels + (y * rows->s_stride)), rows->width);
+}
+
+static void surface_to_rgba_band(void *data, int y0, int y1) {
+    convert_rows_t *rows = data;
+    int y;
+
+    for (y = y0; y < y1; y++)
+        surface_to_rgba_row(rows->d_pixels + (y * rows->d_stride),
+                            (const guint32 *) (rows->s_pixels + (y * rows->s_stride)), rows->width);
+}
+
 /**
 * pixbuf_cairo_create:
 * @pixbuf: GdkPixbuf that you wish to wrap with cairo context
@@ -35,11 +231,11 @@ pixbuf_to_surface(GdkPixbuf *pixbuf) {
     height,       /* Height of both pixbuf and surface */
     p_stride,     /* Pixbuf stride value */
     p_n_channels, /* RGB -> 3, RGBA -> 4 */
-    s_stride,     /* Surface stride value */
-    j;
+    s_stride;     /* Surface stride value */
     guchar *p_pixels,     /* Pixbuf's pixel data */
     *s_pixels;     /* Surface's pixel data */
     cairo_surface_t *surface;      /* Temporary image surface */
+    convert_rows_t rows;
 
     g_object_ref(G_OBJECT(pixbuf));
 
@@ -55,57 +251,13 @@ pixbuf_to_surface(GdkPixbuf *pixbuf) {
     s_pixels = cairo_image_surface_get_data(surface);
 
     /* Copy pixel data from pixbuf to surface */
-    for (j = height; j; j--) {
-        guchar *p = p_pixels;
-        guchar *q = s_pixels;
-
-        if (p_n_channels == 3) {
-            guchar *end = p + 3 * width;
-
-            while (p < end) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-                q[0] = p[2];
-                q[1] = p[1];
-                q[2] = p[0];
-                q[3] = 0xFF;
-#else
-                q[0] = 0xFF;
-              q[1] = p[0];
-              q[2] = p[1];
-              q[3] = p[2];
-#endif
-                p += 3;
-                q += 4;
-            }
-        } else {
-            guchar *end = p + 4 * width;
-            guint t1, t2, t3;
-
-#define MULT(d, c, a, t) G_STMT_START { t = c * a + 0x80; d = ((t >> 8) + t) >> 8; } G_STMT_END
-
-            while (p < end) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-                MULT(q[0], p[2], p[3], t1);
-                MULT(q[1], p[1], p[3], t2);
-                MULT(q[2], p[0], p[3], t3);
-                q[3] = p[3];
-#else
-                q[0] = p[3];
-              MULT(q[1], p[0], p[3], t1);
-              MULT(q[2], p[1], p[3], t2);
-              MULT(q[3], p[2], p[3], t3);
-#endif
-
-                p += 4;
-                q += 4;
-            }
+    rows.s_pixels = p_pixels;
+    rows.s_stride = p_stride;
+    rows.d_pixels = s_pixels;
+    rows.d_stride = s_stride;
+    rows.width = width;
+    convert_bands(height, width, p_n_channels == 4 ? rgba_to_surface_band : rgb_to_surface_band, &rows);
 
-#undef MULT
-        }
-
-        p_pixels += p_stride;
-        s_pixels += s_stride;
-    }
     g_object_unref(G_OBJECT(pixbuf));
 
     cairo_surface_mark_dirty(surface);
@@ -131,11 +283,11 @@ surface_to_pixbuf(cairo_surface_t *surface) {
     height,       /* Height of both pixbuf and surface */
     p_stride,     /* Pixbuf stride value */
     p_n_channels, /* RGB -> 3, RGBA -> 4 */
-    s_stride,     /* Surface stride value */
-    j;
+    s_stride;     /* Surface stride value */
     guchar *p_pixels,     /* Pixbuf's pixel data */
     *s_pixels;     /* Surface's pixel data */
     GdkPixbuf *pixbuf;       /* Pixbuf to be returned */
+    convert_rows_t rows;
     cairo_format_t format;  /* cairo surface format */
 
     format = cairo_image_surface_get_format(surface);
@@ -173,61 +325,70 @@ surface_to_pixbuf(cairo_surface_t *surface) {
 
 
     /* Copy pixel data from surface to pixbuf */
-    for (j = height; j; j--) {
-        guchar *p = p_pixels;
-        guchar *q = s_pixels;
-
-        if (p_n_channels == 3) {
-            guchar *end = p + 3 * width;
-
-            while (p < end) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-                p[2] = q[0];
-                p[1] = q[1];
-                p[0] = q[2];
-#else
-                p[0] = q[1];
-                p[1] = q[2];
-                p[2] = q[3];
-#endif
-                p += 3;
-                q += 4;
-            }
-        } else {
-            guchar *end = p + 4 * width;
-            guint t1, t2, t3;
-
-#define UNMULT(s_byte, p_byte, a, t) G_STMT_START { \
-t = s_byte * 255 / a;                         \
-p_byte = t; \
-} G_STMT_END
-
-            while (p < end) {
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN
-                UNMULT(q[0], p[2], q[3], t1);
-                UNMULT(q[1], p[1], q[3], t2);
-                UNMULT(q[2], p[0], q[3], t3);
-                p[3] = q[3];
-#else
-                p[3] = q[0];
-                UNMULT(q[1], p[0], q[3], t1);
-                UNMULT(q[2], p[1], q[3], t2);
-                UNMULT(q[3], p[2], q[3], t3);
-#endif
+    cairo_surface_flush(surface);
+    rows.s_pixels = s_pixels;
+    rows.s_stride = s_stride;
+    rows.d_pixels = p_pixels;
+    rows.d_stride = p_stride;
+    rows.width = width;
+    convert_bands(height, width, p_n_channels == 4 ? surface_to_rgba_band : surface_to_rgb_band, &rows);
 
-                p += 4;
-                q += 4;
-            }
+    /* Return pixbuf */
+    return (pixbuf);
+}
 
-#undef MULT
-        }
+static void
+release_surface(guchar *pixels, gpointer surface) {
+    cairo_surface_destroy(surface);
+}
+
+/*
+ * Like surface_to_pixbuf(), but converts the surface's pixels where they are
+ * and returns a pixbuf that wraps them, with the surface's stride. The pixbuf
+ * holds a reference to the surface, which is released when the pixbuf is
+ * finalized, so the buffer outlives whichever of the two goes first. The
+ * surface is left holding pixbuf data and must not be drawn on or read
+ * afterwards.
+ */
+static GdkPixbuf *
+surface_to_pixbuf_in_place(cairo_surface_t *surface) {
+    gint width, height, stride, n_channels;
+    guchar *pixels;
+    GdkPixbuf *pixbuf;
+    convert_rows_t rows;
 
-        p_pixels += p_stride;
-        s_pixels += s_stride;
+    switch (cairo_image_surface_get_format(surface)) {
+        case CAIRO_FORMAT_ARGB32:
+            n_channels = 4;
+            break;
+        case CAIRO_FORMAT_RGB24:
+            n_channels = 3;
+            break;
+        default:
+            return (GdkPixbuf *) 0;
     }
 
-    /* Return pixbuf */
-    return (pixbuf);
+    width = cairo_image_surface_get_width(surface);
+    height = cairo_image_surface_get_height(surface);
+    stride = cairo_image_surface_get_stride(surface);
+    pixels = cairo_image_surface_get_data(surface);
+
+    if (width <= 0 || height <= 0 || pixels == NULL)
+        return (GdkPixbuf *) 0;
+
+    /* Each row is converted within itself; RGB pixels are packed down over the words already read */
+    cairo_surface_flush(surface);
+    rows.s_pixels = pixels;
+    rows.s_stride = stride;
+    rows.d_pixels = pixels;
+    rows.d_stride = stride;
+    rows.width = width;
+    convert_bands(height, width, n_channels == 4 ? surface_to_rgba_band : surface_to_rgb_band, &rows);
+
+    pixbuf = gdk_pixbuf_new_from_data(pixels, GDK_COLORSPACE_RGB, n_channels == 4, 8, width, height, stride,
+                                      release_surface, cairo_surface_reference(surface));
+
+    return pixbuf;
 }
 
 static
@@ -251,10 +412,46 @@ VALUE rb_surface_to_pixbuf(__attribute__((unused)) VALUE _self, VALUE surface) {
     return Qnil;
 }
 
+static
+VALUE rb_surface_to_pixbuf_bang(__attribute__((unused)) VALUE _self, VALUE surface) {
+    VALUE obj;
+    GdkPixbuf *pixbuf = surface_to_pixbuf_in_place(RVAL2CRSURFACE(surface));
+    if (pixbuf) {
+        obj = GOBJ2RVAL(pixbuf);
+        g_object_unref(pixbuf);
+        return obj;
+    }
+
+    rb_raise(rb_eRuntimeError, "Unable to convert Cairo::ImageSurface to Gdk::Pixbuf");
+
+    return Qnil;
+}
+
+static
+VALUE rb_concurrency(__attribute__((unused)) VALUE _self) {
+    return INT2NUM(g_atomic_int_get(&convert_concurrency));
+}
+
+static
+VALUE rb_concurrency_equals(__attribute__((unused)) VALUE _self, VALUE concurrency) {
+    int n = NUM2INT(concurrency);
+
+    if (n < 1) {
+        rb_raise(rb_eArgError, "Invalid concurrency - %i", n);
+    }
+    convert_set_concurrency(n);
+    return concurrency;
+}
+
 /* Init */
 void
 Init_gdk_pixbuf_cairo(void) {
     mGdkPixbufCairo = rb_define_module("GdkPixbufCairo");
+    unmult_init();
+    convert_init();
     rb_define_singleton_method(mGdkPixbufCairo, "pixbuf_to_surface", rb_pixbuf_to_surface, 1);
     rb_define_singleton_method(mGdkPixbufCairo, "surface_to_pixbuf", rb_surface_to_pixbuf, 1);
+    rb_define_singleton_method(mGdkPixbufCairo, "surface_to_pixbuf!", rb_surface_to_pixbuf_bang, 1);
+    rb_define_singleton_method(mGdkPixbufCairo, "concurrency", rb_concurrency, 0);
+    rb_define_singleton_method(mGdkPixbufCairo, "concurrency=", rb_concurrency_equals, 1);
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+/*
+ * Bilinear sampling for the affine resamplers (straighten, border)
+ *
+ * These stand in for pixbufs painted through Cairo with its default filter,
+ * so they sample the way pixman does: positions are 16.16 fixed point with
+ * pixel centres on whole numbers, the weights are cut to 7 bits, and taps
+ * outside the source are transparent. Colours come out premultiplied, with
+ * the rounding GdkPixbufCairo.pixbuf_to_surface uses.
+ */
+
+#define BILINEAR_WEIGHT_BITS 7
+
+typedef struct {
+    const guchar *pix;
+    int width, height, rowstride, channels;
+} bilinear_source_t;
+
+static void bilinear_source_init(bilinear_source_t *src, GdkPixbuf *pixbuf) {
+    src->pix = gdk_pixbuf_get_pixels(pixbuf);
+    src->width = gdk_pixbuf_get_width(pixbuf);
+    src->height = gdk_pixbuf_get_height(pixbuf);
+    src->rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    src->channels = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
+}
+
+static inline int bilinear_premultiply(int c, int a) {
+    int t = (c * a) + 0x80;
+    return ((t >> 8) + t) >> 8;
+}
+
+/* Source pixel (x, y) as premultiplied RGBA; transparent black outside the source */
+static inline void bilinear_tap(const bilinear_source_t *src, int x, int y, int rgba[4]) {
+    const guchar *sp;
+
+    if (x < 0 || y < 0 || x >= src->width || y >= src->height) {
+        rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0;
+        return;
+    }
+
+    sp = src->pix + (y * src->rowstride) + (x * src->channels);
+    if (src->channels == 4) {
+        rgba[0] = bilinear_premultiply(sp[0], sp[3]);    /* red */
+        rgba[1] = bilinear_premultiply(sp[1], sp[3]);    /* green */
+        rgba[2] = bilinear_premultiply(sp[2], sp[3]);    /* blue */
+        rgba[3] = sp[3];    /* alpha */
+    } else {
+        rgba[0] = sp[0];    /* red */
+        rgba[1] = sp[1];    /* green */
+        rgba[2] = sp[2];    /* blue */
+        rgba[3] = 0xff;    /* alpha */
+    }
+}
+
+/* Premultiplied RGBA at 16.16 fixed point position (fx, fy) */
+static inline void bilinear_sample(const bilinear_source_t *src, gint64 fx, gint64 fy, int rgba[4]) {
+    const int weight_mask = (1 << BILINEAR_WEIGHT_BITS) - 1;
+    int ix = (int) (fx >> 16), iy = (int) (fy >> 16);
+    int wx = (int) ((fx >> (16 - BILINEAR_WEIGHT_BITS)) & weight_mask) << (8 - BILINEAR_WEIGHT_BITS);
+    int wy = (int) ((fy >> (16 - BILINEAR_WEIGHT_BITS)) & weight_mask) << (8 - BILINEAR_WEIGHT_BITS);
+    int w_tl, w_tr, w_bl, w_br, c;
+    int tl[4], tr[4], bl[4], br[4];
+
+    /* Weights out of 256 * 256 */
+    w_br = wx * wy;
+    w_tr = (wx << 8) - w_br;
+    w_bl = (wy << 8) - w_br;
+    w_tl = (256 * 256) - (wx << 8) - (wy << 8) + w_br;
+
+    if (src->channels == 3 && ix >= 0 && iy >= 0 && ix + 1 < src->width && iy + 1 < src->height) {
+        const guchar *p0 = src->pix + (iy * src->rowstride) + (ix * 3);
+        const guchar *p1 = p0 + src->rowstride;
+
+        for (c = 0; c < 3; c++)
+            rgba[c] = ((p0[c] * w_tl) + (p0[c + 3] * w_tr) + (p1[c] * w_bl) + (p1[c + 3] * w_br)) >> 16;
+        rgba[3] = 0xff;
+        return;
+    }
+
+    bilinear_tap(src, ix, iy, tl);
+    bilinear_tap(src, ix + 1, iy, tr);
+    bilinear_tap(src, ix, iy + 1, bl);
+    bilinear_tap(src, ix + 1, iy + 1, br);
+
+    for (c = 0; c < 4; c++)
+        rgba[c] = ((tl[c] * w_tl) + (tr[c] * w_tr) + (bl[c] * w_bl) + (br[c] * w_br)) >> 16;
+}
+
+/* A position in 16.16 fixed point, rounded to nearest */
+static inline gint64 bilinear_fixed(double v) {
+    return (gint64) floor((v * 65536) + 0.5);
+}
@@ -0,0 +1,201 @@
+/*
+ * Square and rounded (retro) photo borders
+ *
+ * This reproduces what Morandi::Operation::ImageBorder used to draw with
+ * Cairo onto an RGB24 surface the size of the source: white everywhere, the
+ * border colour over the frame rectangle, then the photo - shrunk by scale
+ * and placed at origin - painted through a clip of the photo rectangle,
+ * whose corners are the Bezier curves of CairoExt.rounded_rectangle.
+ *
+ * Each destination pixel is written once. Pixels wholly inside the clip take
+ * the bilinear sample of the photo (see bilinear.h) and pixels wholly
+ * outside take the background, so only those the clip edge crosses - along
+ * the corner curves, and along the straight edges when they fall between
+ * pixels - need their coverage measured. Coverage is the area inside the
+ * clip, exact across each row and sampled on BORDER_SUBROWS lines down it.
+ */
+
+#define BORDER_SUBROWS 16
+
+typedef struct {
+    guchar colour[3];
+    /* Frame rectangle, filled with colour; whole pixels */
+    int frame_x0, frame_y0, frame_x1, frame_y1;
+    /* Photo clip rectangle and its corner radii */
+    double clip_x0, clip_y0, clip_x1, clip_y1;
+    double radius_x, radius_y;
+    /* Photo pixel (u, v) lands at origin + (u, v) * scale */
+    double origin_x, origin_y, scale;
+} border_spec_t;
+
+typedef struct {
+    const border_spec_t *spec;
+    bilinear_source_t src;
+    guchar *d_pix;
+    int d_width, d_rowstride;
+} border_t;
+
+/*
+ * How far the corner curve lies in from the side of the clip, at depth
+ * from the top or bottom of it. Scaled to a unit square the curve runs
+ * a(t) = 1.5t^2 - 0.5t^3 in from the side while b(t) = (1 - t)^2 (1 + t / 2)
+ * from the top or bottom, with b falling steadily from 1 to 0.
+ */
+static double border_corner_inset(const border_spec_t *spec, double depth) {
+    double b = depth / spec->radius_y, lo = 0, hi = 1, t;
+    int i;
+
+    if (b >= 1)
+        return 0;
+
+    for (i = 0; i < 24; i++) {
+        t = (lo + hi) / 2;
+        if ((1 - t) * (1 - t) * (1 + (t / 2)) > b)
+            lo = t;
+        else
+            hi = t;
+    }
+    t = (lo + hi) / 2;
+
+    return spec->radius_x * ((1.5 * t * t) - (0.5 * t * t * t));
+}
+
+/* The part of sub-row ys inside the clip, as left..right; empty when right <= left */
+static void border_span(const border_spec_t *spec, double ys, double *left, double *right) {
+    double inset = 0;
+
+    if (ys < spec->clip_y0 || ys >= spec->clip_y1) {
+        *left = *right = spec->clip_x0;
+        return;
+    }
+
+    if (spec->radius_x > 0 && spec->radius_y > 0) {
+        if (ys - spec->clip_y0 < spec->radius_y)
+            inset = border_corner_inset(spec, ys - spec->clip_y0);
+        else if (spec->clip_y1 - ys < spec->radius_y)
+            inset = border_corner_inset(spec, spec->clip_y1 - ys);
+    }
+
+    *left = spec->clip_x0 + inset;
+    *right = spec->clip_x1 - inset;
+}
+
+/* Clip coverage of pixel x out of 255, from the row's sub-row spans */
+static int border_coverage(const double *left, const double *right, int x) {
+    double area = 0;
+    int k;
+
+    for (k = 0; k < BORDER_SUBROWS; k++) {
+        double l = MAX(left[k], x), r = MIN(right[k], x + 1);
+        if (r > l)
+            area += r - l;
+    }
+
+    return (int) ((area * 255 / BORDER_SUBROWS) + 0.5);
+}
+
+static void border_band(void *data, int y0, int y1) {
+    const border_t *op = data;
+    const border_spec_t *spec = op->spec;
+    static const guchar white[3] = {0xff, 0xff, 0xff};
+    double left[BORDER_SUBROWS], right[BORDER_SUBROWS];
+    gint64 fx0, fy, step;
+    int x, y, k;
+
+    step = bilinear_fixed(1 / spec->scale);
+    fx0 = bilinear_fixed(((0.5 - spec->origin_x) / spec->scale) - 0.5);
+
+    for (y = y0; y < y1; y++) {
+        guchar *dp = op->d_pix + (y * op->d_rowstride);
+        gboolean in_frame = y >= spec->frame_y0 && y < spec->frame_y1;
+        double inner_l = -HUGE_VAL, inner_r = HUGE_VAL, outer_l = HUGE_VAL, outer_r = -HUGE_VAL;
+        int full_x0, full_x1, part_x0, part_x1;
+
+        for (k = 0; k < BORDER_SUBROWS; k++) {
+            border_span(spec, y + ((k + 0.5) / BORDER_SUBROWS), &left[k], &right[k]);
+            inner_l = MAX(inner_l, left[k]);
+            inner_r = MIN(inner_r, right[k]);
+            if (right[k] > left[k]) {
+                outer_l = MIN(outer_l, left[k]);
+                outer_r = MAX(outer_r, right[k]);
+            }
+        }
+
+        /* Pixels full_x0..full_x1-1 are wholly inside the clip, part_x0..part_x1-1 at least partly */
+        part_x0 = (outer_l < outer_r) ? CLAMP((int) floor(outer_l), 0, op->d_width) : 0;
+        part_x1 = (outer_l < outer_r) ? CLAMP((int) ceil(outer_r), part_x0, op->d_width) : 0;
+        full_x0 = (inner_l < inner_r) ? CLAMP((int) ceil(inner_l), part_x0, part_x1) : part_x0;
+        full_x1 = (inner_l < inner_r) ? CLAMP((int) floor(inner_r), full_x0, part_x1) : part_x0;
+
+        fy = bilinear_fixed(((y + 0.5 - spec->origin_y) / spec->scale) - 0.5);
+
+        for (x = 0; x < op->d_width; x++, dp += 3) {
+            const guchar *base = (in_frame && x >= spec->frame_x0 && x < spec->frame_x1) ? spec->colour : white;
+            int rgba[4], cover, c;
+
+            if (x < part_x0 || x >= part_x1) {
+                dp[0] = base[0];
+                dp[1] = base[1];
+                dp[2] = base[2];
+                continue;
+            }
+
+            cover = (x >= full_x0 && x < full_x1) ? 0xff : border_coverage(left, right, x);
+            if (cover == 0) {
+                dp[0] = base[0];
+                dp[1] = base[1];
+                dp[2] = base[2];
+                continue;
+            }
+
+            bilinear_sample(&op->src, fx0 + (x * step), fy, rgba);
+
+            /* Photo in the clip coverage, over the background */
+            if (cover != 0xff) {
+                for (c = 0; c < 4; c++)
+                    rgba[c] = bilinear_premultiply(rgba[c], cover);
+            }
+            for (c = 0; c < 3; c++)
+                dp[c] = rgba[c] + bilinear_premultiply(base[c], 0xff - rgba[3]);
+        }
+    }
+}
+
+/* Draws the border described by spec around src into dest, an RGB pixbuf the size of src */
+static GdkPixbuf *pixbuf_border_into(GdkPixbuf *src, GdkPixbuf *dest, const border_spec_t *spec) {
+    border_t op;
+    int width, height;
+
+    g_return_val_if_fail(src != NULL, NULL);
+    if (dest == NULL)
+        return NULL;
+
+    width = gdk_pixbuf_get_width(src);
+    height = gdk_pixbuf_get_height(src);
+
+    g_return_val_if_fail(gdk_pixbuf_get_width(dest) == width, NULL);
+    g_return_val_if_fail(gdk_pixbuf_get_height(dest) == height, NULL);
+    g_return_val_if_fail(!gdk_pixbuf_get_has_alpha(dest), NULL);
+
+    op.spec = spec;
+    bilinear_source_init(&op.src, src);
+    op.d_pix = gdk_pixbuf_get_pixels(dest);
+    op.d_width = width;
+    op.d_rowstride = gdk_pixbuf_get_rowstride(dest);
+
+    parallel_rows(height, width, border_band, &op);
+
+    return dest;
+}
+
+static GdkPixbuf *pixbuf_border(GdkPixbuf *src, const border_spec_t *spec) {
+    GdkPixbuf *dest;
+
+    g_return_val_if_fail(src != NULL, NULL);
+
+    dest = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, gdk_pixbuf_get_width(src), gdk_pixbuf_get_height(src));
+    if (dest == NULL)
+        return NULL;
+
+    return pixbuf_border_into(src, dest, spec);
+}
@@ -0,0 +1,127 @@
+/*
+ * Crops that reach past the edges of the image
+ *
+ * The destination is always RGB. Rows that overlap the source copy the
+ * overlapping span straight across and fill the margins either side; rows
+ * wholly outside it are filled. Source alpha is blended over the fill colour
+ * exactly as gdk_pixbuf_composite() does at scale 1:
+ * (alpha * src + (255 - alpha) * fill) / 255, rounded down.
+ */
+
+typedef struct {
+    const guchar *s_pix;
+    int s_rowstride, s_channels;
+    guchar *d_pix;
+    int d_width, d_rowstride;
+    /* Overlap: destination rows copy_y0..copy_y1-1, columns copy_x0..copy_x1-1 */
+    int copy_x0, copy_x1, copy_y0, copy_y1;
+    /* Source pixel that lands on destination (0, 0) */
+    int src_x, src_y;
+    guchar fill[3];
+} crop_fill_t;
+
+/* floor(x / 255) for x up to 255 * 255 */
+#define DIV_255(x) (((x) + 1 + ((x) >> 8)) >> 8)
+
+static inline void crop_fill_span(const crop_fill_t *op, guchar *dp, int from, int to) {
+    int x;
+
+    for (x = from; x < to; x++) {
+        dp[(x * 3) + 0] = op->fill[0];
+        dp[(x * 3) + 1] = op->fill[1];
+        dp[(x * 3) + 2] = op->fill[2];
+    }
+}
+
+static void crop_fill_band(void *data, int y0, int y1) {
+    const crop_fill_t *op = data;
+    int x, y, c;
+
+    for (y = y0; y < y1; y++) {
+        guchar *dp = op->d_pix + (y * op->d_rowstride);
+        const guchar *sp;
+
+        if (y < op->copy_y0 || y >= op->copy_y1 || op->copy_x0 >= op->copy_x1) {
+            crop_fill_span(op, dp, 0, op->d_width);
+            continue;
+        }
+
+        crop_fill_span(op, dp, 0, op->copy_x0);
+        crop_fill_span(op, dp, op->copy_x1, op->d_width);
+
+        sp = op->s_pix + ((op->src_y + y) * op->s_rowstride) + ((op->src_x + op->copy_x0) * op->s_channels);
+        dp += op->copy_x0 * 3;
+
+        if (op->s_channels == 3) {
+            memcpy(dp, sp, (op->copy_x1 - op->copy_x0) * 3);
+            continue;
+        }
+
+        for (x = op->copy_x0; x < op->copy_x1; x++, sp += 4, dp += 3) {
+            int alpha = sp[3];
+
+            if (alpha == 0xff) {
+                dp[0] = sp[0];
+                dp[1] = sp[1];
+                dp[2] = sp[2];
+            } else {
+                for (c = 0; c < 3; c++)
+                    dp[c] = DIV_255((alpha * sp[c]) + ((0xff - alpha) * op->fill[c]));
+            }
+        }
+    }
+}
+
+#undef DIV_255
+
+/*
+ * Crops the size of dest, an RGB pixbuf, from (x, y) in src, which may lie
+ * partly or wholly outside it; fill is 0xRRGGBBAA
+ */
+static GdkPixbuf *pixbuf_crop_fill_into(GdkPixbuf *src, GdkPixbuf *dest, int x, int y, guint32 fill) {
+    crop_fill_t op;
+    int s_width, s_height, width, height;
+
+    g_return_val_if_fail(src != NULL, NULL);
+    if (dest == NULL)
+        return NULL;
+    g_return_val_if_fail(!gdk_pixbuf_get_has_alpha(dest), NULL);
+
+    width = gdk_pixbuf_get_width(dest);
+    height = gdk_pixbuf_get_height(dest);
+    s_width = gdk_pixbuf_get_width(src);
+    s_height = gdk_pixbuf_get_height(src);
+
+    op.s_pix = gdk_pixbuf_get_pixels(src);
+    op.s_rowstride = gdk_pixbuf_get_rowstride(src);
+    op.s_channels = gdk_pixbuf_get_has_alpha(src) ? 4 : 3;
+    op.d_pix = gdk_pixbuf_get_pixels(dest);
+    op.d_width = width;
+    op.d_rowstride = gdk_pixbuf_get_rowstride(dest);
+    op.src_x = x;
+    op.src_y = y;
+    op.copy_x0 = CLAMP(-x, 0, width);
+    op.copy_x1 = CLAMP(s_width - x, op.copy_x0, width);
+    op.copy_y0 = CLAMP(-y, 0, height);
+    op.copy_y1 = CLAMP(s_height - y, op.copy_y0, height);
+    op.fill[0] = (fill >> 24) & 0xff;
+    op.fill[1] = (fill >> 16) & 0xff;
+    op.fill[2] = (fill >> 8) & 0xff;
+
+    parallel_rows(height, width, crop_fill_band, &op);
+
+    return dest;
+}
+
+/* Crops width x height from (x, y), which may lie partly or wholly outside src; fill is 0xRRGGBBAA */
+static GdkPixbuf *pixbuf_crop_fill(GdkPixbuf *src, int x, int y, int width, int height, guint32 fill) {
+    GdkPixbuf *dest;
+
+    g_return_val_if_fail(src != NULL, NULL);
+
+    dest = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+    if (dest == NULL)
+        return NULL;
+
+    return pixbuf_crop_fill_into(src, dest, x, y, fill);
+}
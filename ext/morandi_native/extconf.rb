@@ -57,6 +57,12 @@ $CFLAGS += " -I#{RbConfig::CONFIG['rubyhdrdir']}/ruby" if RbConfig::CONFIG.key?(
 $CFLAGS += ' -I.'
 have_func('rb_errinfo')
 PKGConfig.have_package('gdk-pixbuf-2.0') or exit(-1)
+# LittleCMS converts embedded colour profiles to sRGB
+PKGConfig.have_package('lcms2') or exit(-1)
+# libjpeg-turbo (1.5 or later) decodes just the part of a JPEG a crop needs; other libjpegs decode it whole
+PKGConfig.have_package('libjpeg') or exit(-1)
+have_func('jpeg_crop_scanline', %w[stdio.h jpeglib.h])
+have_func('jpeg_skip_scanlines', %w[stdio.h jpeglib.h])
 # PKGConfig.have_package('gdk-2.0') or exit(-1)
 
 unless have_header('gdk-pixbuf/gdk-pixbuf.h')
@@ -0,0 +1,384 @@
+/*
+ * Conversion of images with an embedded ICC profile to sRGB
+ *
+ * Replaces running jpgicc over the file before loading it: the decoded
+ * pixels are transformed in place with LittleCMS, from the profile the
+ * loader found in the file to the built-in sRGB profile, with the same
+ * perceptual intent jpgicc uses by default. LittleCMS optimises the
+ * transform into its own 8 bit pipeline; rows are handed to it a band at a
+ * time on the thread pool, which it allows as each call keeps its own cache.
+ *
+ * Profiles that describe themselves as sRGB are left alone, as are profiles
+ * that are not for RGB data (the loader has already turned CMYK into RGB
+ * without one) and anything LittleCMS cannot read.
+ *
+ * Most images come from a handful of cameras and phones with the same few
+ * profiles, so transforms are kept in a small LRU cache, keyed by a hash of
+ * the profile's bytes (compared in full on a match), the intent and the
+ * pixel format. Profiles that are left alone are cached too, so they are
+ * not read again. Entries are counted in and out by the images using them,
+ * and one evicted while in use is freed by the last of those.
+ *
+ * Once a profile has been used icc_cache.lut_after times (if that is set),
+ * its transform is sampled on a 33 point grid and later images are converted
+ * by tetrahedral interpolation in that table, as LittleCMS does for its own
+ * 8 bit pipelines. Results are within a level of the direct transform.
+ */
+
+#include <lcms2.h>
+
+#define ICC_CACHE_DEFAULT 8
+#define ICC_LUT_POINTS 33
+/* Grid positions are in fixed point with this many fraction bits */
+#define ICC_LUT_SHIFT 12
+/* Table outputs are 8 bit levels scaled by 256 */
+#define ICC_LUT_ONE (255 * 256)
+
+typedef struct icc_transform {
+    /* Key */
+    guint64 digest;
+    guchar *profile;
+    gsize length;
+    int intent;
+    cmsUInt32Number format;
+    /* NULL for profiles that are left alone */
+    cmsHTRANSFORM transform;
+    /* RGB for each grid point, red slowest, once built */
+    guint16 *lut;
+    gboolean lut_building;
+    /* Images converted with it, and images converting with it now */
+    int uses, refs;
+    gboolean cached;
+    /* Most recently used first */
+    struct icc_transform *prev, *next;
+} icc_transform_t;
+
+static struct {
+    GMutex lock;
+    icc_transform_t *first, *last;
+    int len, size;
+    guint64 hits, misses;
+    /* Uses before a table is built, 0 for never */
+    int lut_after;
+} icc_cache = {.size = ICC_CACHE_DEFAULT};
+
+typedef struct {
+    cmsHTRANSFORM transform;
+    const guint16 *lut;
+    /* Table offset and fraction of each level along each axis */
+    int offset[3][256], fraction[256];
+    guchar *pixels;
+    int width, rowstride, n_channels;
+} icc_rows_t;
+
+static void icc_rows_band(void *data, int y0, int y1) {
+    const icc_rows_t *op = data;
+    guchar *row = op->pixels + ((gsize) y0 * op->rowstride);
+
+    cmsDoTransformLineStride(op->transform, row, row, op->width, y1 - y0, op->rowstride, op->rowstride, 0, 0);
+}
+
+/* Walks from the cell's first corner along the axes in order of their fractions, largest first */
+static void icc_lut_band(void *data, int y0, int y1) {
+    const icc_rows_t *op = data;
+    int x, y, k;
+
+    for (y = y0; y < y1; y++) {
+        guchar *pixel = op->pixels + ((gsize) y * op->rowstride);
+
+        for (x = 0; x < op->width; x++, pixel += op->n_channels) {
+            const guint16 *c0 = op->lut + op->offset[0][pixel[0]] + op->offset[1][pixel[1]] + op->offset[2][pixel[2]];
+            int f[3] = {op->fraction[pixel[0]], op->fraction[pixel[1]], op->fraction[pixel[2]]};
+            int o[3] = {ICC_LUT_POINTS * ICC_LUT_POINTS * 3, ICC_LUT_POINTS * 3, 3};
+            int a = 0, b = 1, c = 2, swap;
+
+            if (f[a] < f[b]) { swap = a; a = b; b = swap; }
+            if (f[b] < f[c]) { swap = b; b = c; c = swap; }
+            if (f[a] < f[b]) { swap = a; a = b; b = swap; }
+
+            for (k = 0; k < 3; k++) {
+                int v0 = c0[k], v1 = c0[o[a] + k], v2 = c0[o[a] + o[b] + k], v3 = c0[o[a] + o[b] + o[c] + k];
+                int sum = (v0 << ICC_LUT_SHIFT) + ((v1 - v0) * f[a]) + ((v2 - v1) * f[b]) + ((v3 - v2) * f[c]);
+
+                pixel[k] = (sum + (1 << (ICC_LUT_SHIFT + 7))) >> (ICC_LUT_SHIFT + 8);
+            }
+        }
+    }
+}
+
+static void icc_lut_axes(icc_rows_t *op) {
+    int strides[3] = {ICC_LUT_POINTS * ICC_LUT_POINTS * 3, ICC_LUT_POINTS * 3, 3};
+    int v, axis;
+
+    for (v = 0; v < 256; v++) {
+        int position = (v * (ICC_LUT_POINTS - 1) << ICC_LUT_SHIFT) / 255;
+        /* 255 falls on the last point, which is the far corner of the last cell */
+        int index = MIN(position >> ICC_LUT_SHIFT, ICC_LUT_POINTS - 2);
+
+        for (axis = 0; axis < 3; axis++)
+            op->offset[axis][v] = index * strides[axis];
+        op->fraction[v] = position - (index << ICC_LUT_SHIFT);
+    }
+}
+
+static gboolean icc_profile_is_srgb(cmsHPROFILE profile) {
+    char description[256];
+
+    if (cmsGetProfileInfoASCII(profile, cmsInfoDescription, "en", "US", description, sizeof(description)) == 0)
+        return FALSE;
+
+    return strncmp(description, "sRGB", 4) == 0;
+}
+
+/* FNV-1a */
+static guint64 icc_digest(const guchar *data, gsize length) {
+    guint64 digest = G_GUINT64_CONSTANT(14695981039346656037);
+    gsize i;
+
+    for (i = 0; i < length; i++)
+        digest = (digest ^ data[i]) * G_GUINT64_CONSTANT(1099511628211);
+
+    return digest;
+}
+
+static cmsHTRANSFORM icc_create_transform(const icc_transform_t *t, cmsUInt32Number format) {
+    cmsHPROFILE profile = cmsOpenProfileFromMem(t->profile, (cmsUInt32Number) t->length), srgb;
+    cmsHTRANSFORM transform = NULL;
+
+    if (profile == NULL)
+        return NULL;
+
+    if (cmsGetColorSpace(profile) == cmsSigRgbData && !icc_profile_is_srgb(profile)) {
+        srgb = cmsCreate_sRGBProfile();
+        transform = cmsCreateTransform(profile, format, srgb, format, t->intent, 0);
+        cmsCloseProfile(srgb);
+    }
+    cmsCloseProfile(profile);
+
+    return transform;
+}
+
+static icc_transform_t *icc_transform_new(const void *data, gsize length, guint64 digest, int intent,
+                                          cmsUInt32Number format) {
+    icc_transform_t *t = g_new0(icc_transform_t, 1);
+
+    t->digest = digest;
+    t->profile = g_malloc(length);
+    memcpy(t->profile, data, length);
+    t->length = length;
+    t->intent = intent;
+    t->format = format;
+    t->transform = icc_create_transform(t, format);
+
+    return t;
+}
+
+static void icc_transform_free(icc_transform_t *t) {
+    if (t->transform != NULL)
+        cmsDeleteTransform(t->transform);
+    g_free(t->lut);
+    g_free(t->profile);
+    g_free(t);
+}
+
+/* Samples the transform on the grid, from 16 bit input for points between 8 bit levels */
+static guint16 *icc_lut_build(const icc_transform_t *t) {
+    cmsHTRANSFORM transform = icc_create_transform(t, TYPE_RGB_16);
+    int n = ICC_LUT_POINTS * ICC_LUT_POINTS * ICC_LUT_POINTS, r, g, b, i = 0;
+    guint16 *grid, *lut;
+
+    if (transform == NULL)
+        return NULL;
+
+    grid = g_new(guint16, n * 3);
+    for (r = 0; r < ICC_LUT_POINTS; r++) {
+        for (g = 0; g < ICC_LUT_POINTS; g++) {
+            for (b = 0; b < ICC_LUT_POINTS; b++, i += 3) {
+                grid[i] = ((r * 65535) + ((ICC_LUT_POINTS - 1) / 2)) / (ICC_LUT_POINTS - 1);
+                grid[i + 1] = ((g * 65535) + ((ICC_LUT_POINTS - 1) / 2)) / (ICC_LUT_POINTS - 1);
+                grid[i + 2] = ((b * 65535) + ((ICC_LUT_POINTS - 1) / 2)) / (ICC_LUT_POINTS - 1);
+            }
+        }
+    }
+
+    lut = g_new(guint16, n * 3);
+    cmsDoTransform(transform, grid, lut, n);
+    cmsDeleteTransform(transform);
+    g_free(grid);
+
+    for (i = 0; i < n * 3; i++)
+        lut[i] = (((guint32) lut[i] * ICC_LUT_ONE) + 32767) / 65535;
+
+    return lut;
+}
+
+static void icc_cache_unlink(icc_transform_t *t) {
+    if (t->prev != NULL)
+        t->prev->next = t->next;
+    else
+        icc_cache.first = t->next;
+    if (t->next != NULL)
+        t->next->prev = t->prev;
+    else
+        icc_cache.last = t->prev;
+    t->prev = t->next = NULL;
+}
+
+static void icc_cache_push(icc_transform_t *t) {
+    t->prev = NULL;
+    t->next = icc_cache.first;
+    if (icc_cache.first != NULL)
+        icc_cache.first->prev = t;
+    else
+        icc_cache.last = t;
+    icc_cache.first = t;
+}
+
+/* Drops least recently used entries down to the size; call with the lock held */
+static void icc_cache_trim(void) {
+    while (icc_cache.len > icc_cache.size) {
+        icc_transform_t *t = icc_cache.last;
+
+        icc_cache_unlink(t);
+        icc_cache.len--;
+        t->cached = FALSE;
+        if (t->refs == 0)
+            icc_transform_free(t);
+    }
+}
+
+static icc_transform_t *icc_cache_find(guint64 digest, const void *data, gsize length, int intent,
+                                       cmsUInt32Number format) {
+    icc_transform_t *t;
+
+    for (t = icc_cache.first; t != NULL; t = t->next) {
+        if (t->digest == digest && t->length == length && t->intent == intent && t->format == format &&
+            memcmp(t->profile, data, length) == 0)
+            return t;
+    }
+
+    return NULL;
+}
+
+/* The transform for a profile, from the cache or made and added to it; hand it back with icc_cache_release */
+static icc_transform_t *icc_cache_acquire(const void *data, gsize length, int intent, cmsUInt32Number format,
+                                          const guint16 **lut) {
+    guint64 digest = icc_digest(data, length);
+    icc_transform_t *t, *made = NULL;
+    gboolean build_lut;
+
+    g_mutex_lock(&icc_cache.lock);
+    t = icc_cache_find(digest, data, length, intent, format);
+    if (t != NULL) {
+        icc_cache.hits++;
+    } else {
+        icc_cache.misses++;
+        /* Opening the profile takes a while, so is done unlocked; another thread may add it meanwhile */
+        g_mutex_unlock(&icc_cache.lock);
+        made = icc_transform_new(data, length, digest, intent, format);
+        g_mutex_lock(&icc_cache.lock);
+
+        t = icc_cache_find(digest, data, length, intent, format);
+        if (t != NULL) {
+            icc_transform_free(made);
+        } else {
+            t = made;
+            t->cached = TRUE;
+            icc_cache_push(t);
+            icc_cache.len++;
+        }
+    }
+
+    if (t->cached && t != icc_cache.first) {
+        icc_cache_unlink(t);
+        icc_cache_push(t);
+    }
+    t->refs++;
+    t->uses++;
+
+    build_lut = t->transform != NULL && t->lut == NULL && !t->lut_building && icc_cache.lut_after > 0 &&
+                t->uses >= icc_cache.lut_after;
+    if (build_lut)
+        t->lut_building = TRUE;
+    /* An entry past the size (0 turns caching off) still serves this image */
+    icc_cache_trim();
+    g_mutex_unlock(&icc_cache.lock);
+
+    if (build_lut) {
+        guint16 *built = icc_lut_build(t);
+
+        g_mutex_lock(&icc_cache.lock);
+        t->lut = built;
+        t->lut_building = FALSE;
+        g_mutex_unlock(&icc_cache.lock);
+    }
+
+    g_mutex_lock(&icc_cache.lock);
+    *lut = t->lut;
+    g_mutex_unlock(&icc_cache.lock);
+
+    return t;
+}
+
+static void icc_cache_release(icc_transform_t *t) {
+    g_mutex_lock(&icc_cache.lock);
+    if (--t->refs == 0 && !t->cached)
+        icc_transform_free(t);
+    g_mutex_unlock(&icc_cache.lock);
+}
+
+static void icc_cache_resize(int size) {
+    g_mutex_lock(&icc_cache.lock);
+    icc_cache.size = size;
+    icc_cache_trim();
+    g_mutex_unlock(&icc_cache.lock);
+}
+
+/* Empties the cache and zeroes its counters */
+static void icc_cache_clear(void) {
+    g_mutex_lock(&icc_cache.lock);
+    icc_cache.hits = icc_cache.misses = 0;
+    while (icc_cache.last != NULL) {
+        icc_transform_t *t = icc_cache.last;
+
+        icc_cache_unlink(t);
+        t->cached = FALSE;
+        if (t->refs == 0)
+            icc_transform_free(t);
+    }
+    icc_cache.len = 0;
+    g_mutex_unlock(&icc_cache.lock);
+}
+
+/* Transforms pixbuf in place from the ICC profile in data to sRGB; FALSE if it was left alone */
+static gboolean pixbuf_icc_to_srgb(GdkPixbuf *pixbuf, const void *data, gsize length, int intent) {
+    icc_transform_t *t;
+    icc_rows_t op;
+    /* Alpha is an extra channel LittleCMS skips, so in place it is left as it was */
+    cmsUInt32Number format = gdk_pixbuf_get_has_alpha(pixbuf) ? TYPE_RGBA_8 : TYPE_RGB_8;
+
+    g_return_val_if_fail(pixbuf != NULL, FALSE);
+
+    t = icc_cache_acquire(data, length, intent, format, &op.lut);
+    if (t->transform == NULL) {
+        icc_cache_release(t);
+        return FALSE;
+    }
+
+    op.transform = t->transform;
+    op.pixels = gdk_pixbuf_get_pixels(pixbuf);
+    op.width = gdk_pixbuf_get_width(pixbuf);
+    op.rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    op.n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+
+    if (op.lut != NULL) {
+        icc_lut_axes(&op);
+        parallel_rows(gdk_pixbuf_get_height(pixbuf), op.width, icc_lut_band, &op);
+    } else {
+        parallel_rows(gdk_pixbuf_get_height(pixbuf), op.width, icc_rows_band, &op);
+    }
+
+    icc_cache_release(t);
+
+    return TRUE;
+}
@@ -0,0 +1,132 @@
+/*
+ * Decoding only part of a JPEG
+ *
+ * With a tight crop and no straightening the pipeline starts by cropping the
+ * source to the region it needs (see Pipeline#source_region), throwing the
+ * rest of a full decode away. libjpeg-turbo can skip the rows above that
+ * region, which it only has to entropy decode, stop once the region's last row
+ * is read, and limit each row to the iMCU columns covering the region, so the
+ * inverse DCT, upsampling and colour conversion are done for the region alone.
+ *
+ * Only images libjpeg converts to RGB itself are decoded here; CMYK and the
+ * like come back as NULL for gdk-pixbuf to load whole. So do files libjpeg
+ * warns about (such as a premature end), so broken images still get the
+ * loader's own handling.
+ *
+ * jpeg_crop_scanline() and jpeg_skip_scanlines() are libjpeg-turbo 1.5+ only;
+ * without them (see extconf.rb) every region comes back as NULL and callers
+ * decode the whole image instead.
+ */
+
+#include <jpeglib.h>
+#include <setjmp.h>
+
+#if defined(HAVE_JPEG_CROP_SCANLINE) && defined(HAVE_JPEG_SKIP_SCANLINES)
+#define JPEG_REGIONS TRUE
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} jpeg_region_error_t;
+
+static void jpeg_region_error_exit(j_common_ptr cinfo) {
+    jpeg_region_error_t *err = (jpeg_region_error_t *) cinfo->err;
+
+    longjmp(err->jump, 1);
+}
+
+/* Warnings (negative levels) mean libjpeg made up some of the image */
+static void jpeg_region_emit_message(j_common_ptr cinfo, int msg_level) {
+    if (msg_level < 0)
+        jpeg_region_error_exit(cinfo);
+}
+
+/* Decodes the given part of the image in a JPEG file as RGB, or returns NULL if it cannot */
+static GdkPixbuf *pixbuf_load_jpeg_region(const char *path, int x, int y, int width, int height) {
+    struct jpeg_decompress_struct cinfo;
+    jpeg_region_error_t err;
+    GdkPixbuf *volatile pixbuf = NULL;
+    JSAMPLE *volatile row = NULL;
+    FILE *file;
+    JDIMENSION x0, row_width;
+    guchar *pixels;
+    int rowstride, i;
+
+    if (x < 0 || y < 0 || width < 1 || height < 1)
+        return NULL;
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = jpeg_region_error_exit;
+    err.pub.emit_message = jpeg_region_emit_message;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        g_free(row);
+        if (pixbuf != NULL)
+            g_object_unref(pixbuf);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, file);
+    jpeg_read_header(&cinfo, TRUE);
+
+    if ((cinfo.jpeg_color_space != JCS_YCbCr && cinfo.jpeg_color_space != JCS_GRAYSCALE &&
+         cinfo.jpeg_color_space != JCS_RGB) ||
+        (JDIMENSION) x + width > cinfo.image_width || (JDIMENSION) y + height > cinfo.image_height)
+        jpeg_region_error_exit((j_common_ptr) &cinfo);
+
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    /*
+     * Widened to whole iMCU columns; x0 is where the rows read start. Upsampled
+     * chroma is extended at the edges of the rows read, so a column either side
+     * of the region is asked for to keep it the same as in a full decode.
+     */
+    x0 = MAX(x - 1, 0);
+    row_width = MIN((JDIMENSION) x + width + 1, cinfo.output_width) - x0;
+    jpeg_crop_scanline(&cinfo, &x0, &row_width);
+    if (y > 0 && jpeg_skip_scanlines(&cinfo, y) != (JDIMENSION) y)
+        jpeg_region_error_exit((j_common_ptr) &cinfo);
+
+    pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+    if (pixbuf == NULL)
+        jpeg_region_error_exit((j_common_ptr) &cinfo);
+    pixels = gdk_pixbuf_get_pixels(pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    row = g_malloc((gsize) row_width * 3);
+
+    for (i = 0; i < height; i++) {
+        JSAMPROW rows[1] = {row};
+
+        if (jpeg_read_scanlines(&cinfo, rows, 1) != 1)
+            jpeg_region_error_exit((j_common_ptr) &cinfo);
+        memcpy(pixels + ((gsize) i * rowstride), row + ((x - x0) * 3), (gsize) width * 3);
+    }
+
+    /* The rows below are never read */
+    jpeg_abort_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(file);
+    g_free(row);
+
+    return pixbuf;
+}
+
+#else
+#define JPEG_REGIONS FALSE
+
+static GdkPixbuf *pixbuf_load_jpeg_region(const char *path, int x, int y, int width, int height) {
+    IGNORE(path);
+    IGNORE(x);
+    IGNORE(y);
+    IGNORE(width);
+    IGNORE(height);
+    return NULL;
+}
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Connected component labelling of red-eye masks
+ *
+ * Two passes with union-find. The first gives each marked pixel a label
+ * from its already visited 8-connected neighbours, or a new one, and joins
+ * the sets of labels that meet there (by rank, halving paths as it goes).
+ * The second replaces every label with its component's and gathers each
+ * component's bounding box and pixel count, so merged regions always carry
+ * the stats of all their pixels however long the chain that joined them.
+ *
+ * Components are numbered from 1 in the order their first pixel comes in a
+ * raster scan, which is the order of the smallest label in each.
+ *
+ * Labels are stored in 16 bits, and only widened to 32 when a scan needs
+ * more provisional labels than that. The label and union-find buffers are
+ * kept between runs, growing as needed.
+ */
+
+#define LABEL_SETS_DEFAULT 64
+
+typedef struct {
+    int minX, maxX, minY, maxY;
+    int width, height;
+    int noPixels;
+} region_info;
+
+typedef struct {
+    /* Component of each pixel, 0 for none; guint16, or guint32 when wide */
+    void *data;
+    gboolean wide;
+    gsize data_size;
+    /* Pixels in the current run */
+    int n_pixels;
+    /* Stats of each component, from 1; len is one more than the number of components */
+    region_info *region;
+    int len, size;
+    /* Union-find over provisional labels, and the component each set becomes */
+    struct {
+        int *parent, *component;
+        guchar *rank;
+        int len, size;
+    } sets;
+} label_regions_t;
+
+static inline int label_at(const label_regions_t *regions, int index) {
+    return regions->wide ? (int) ((const guint32 *) regions->data)[index] : ((const guint16 *) regions->data)[index];
+}
+
+static inline void label_set(label_regions_t *regions, int index, int label) {
+    if (regions->wide)
+        ((guint32 *) regions->data)[index] = label;
+    else
+        ((guint16 *) regions->data)[index] = label;
+}
+
+/* Makes room for labels of n pixels, narrow to start with */
+static void label_reserve(label_regions_t *regions, int n) {
+    if (regions->data_size < sizeof(guint16) * n) {
+        regions->data_size = sizeof(guint16) * n;
+        regions->data = g_realloc(regions->data, regions->data_size);
+    }
+    regions->wide = FALSE;
+    regions->n_pixels = n;
+}
+
+/* Moves the first n labels to 32 bits, working back from the end so none is overwritten before it is read */
+static void label_widen(label_regions_t *regions, int n) {
+    guint16 *narrow;
+    guint32 *wide;
+    int i;
+
+    if (regions->data_size < sizeof(guint32) * regions->n_pixels) {
+        regions->data_size = sizeof(guint32) * regions->n_pixels;
+        regions->data = g_realloc(regions->data, regions->data_size);
+    }
+
+    narrow = regions->data;
+    wide = regions->data;
+    for (i = n - 1; i >= 0; i--)
+        wide[i] = narrow[i];
+
+    regions->wide = TRUE;
+}
+
+/* A new provisional label for pixel index, which is the first pixel without one */
+static int label_new(label_regions_t *regions, int index) {
+    int label = regions->sets.len;
+
+    if (!regions->wide && label > G_MAXUINT16)
+        label_widen(regions, index);
+
+    if (label == regions->sets.size) {
+        regions->sets.size = MAX(regions->sets.size * 2, LABEL_SETS_DEFAULT);
+        regions->sets.parent = g_renew(int, regions->sets.parent, regions->sets.size);
+        regions->sets.rank = g_renew(guchar, regions->sets.rank, regions->sets.size);
+    }
+
+    regions->sets.parent[label] = label;
+    regions->sets.rank[label] = 0;
+    regions->sets.len++;
+
+    return label;
+}
+
+static inline int label_find(label_regions_t *regions, int label) {
+    int *parent = regions->sets.parent;
+
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+
+    return label;
+}
+
+static int label_union(label_regions_t *regions, int a, int b) {
+    guchar *rank = regions->sets.rank;
+
+    a = label_find(regions, a);
+    b = label_find(regions, b);
+    if (a == b)
+        return a;
+
+    if (rank[a] < rank[b]) {
+        int swap = a;
+        a = b;
+        b = swap;
+    }
+    regions->sets.parent[b] = a;
+    if (rank[a] == rank[b])
+        rank[a]++;
+
+    return a;
+}
+
+/* First pass: provisional labels, with the sets they belong to */
+static void label_provisional(label_regions_t *regions, const guchar *mask, int width, int height) {
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        const guchar *m = mask + (y * width);
+        int row = y * width, up = row - width;
+
+        for (x = 0; x < width; x++) {
+            int label = 0, i;
+
+            if (!m[x]) {
+                label_set(regions, row + x, 0);
+                continue;
+            }
+
+            /* Everything else already visited touches the pixel above, so is in its set */
+            if (y > 0 && (label = label_at(regions, up + x)) > 0) {
+                label_set(regions, row + x, label);
+                continue;
+            }
+
+            {
+                int neighbours[3] = {
+                    (x > 0) ? label_at(regions, row + x - 1) : 0,
+                    (y > 0 && x > 0) ? label_at(regions, up + x - 1) : 0,
+                    (y > 0 && x + 1 < width) ? label_at(regions, up + x + 1) : 0
+                };
+
+                for (i = 0; i < 3; i++) {
+                    if (neighbours[i] > 0)
+                        label = (label > 0) ? label_union(regions, label, neighbours[i]) : neighbours[i];
+                }
+            }
+
+            label_set(regions, row + x, (label > 0) ? label : label_new(regions, row + x));
+        }
+    }
+}
+
+/* Labels the components of the marked pixels of mask, a width x height image, into regions */
+static void label_components(label_regions_t *regions, const guchar *mask, int width, int height) {
+    int *component;
+    int x, y, label, n = 0;
+
+    label_reserve(regions, width * height);
+    regions->sets.len = 0;
+    /* 0 is no label */
+    label_new(regions, 0);
+
+    label_provisional(regions, mask, width, height);
+
+    /* Number the components by their smallest label */
+    regions->sets.component = g_renew(int, regions->sets.component, regions->sets.size);
+    component = regions->sets.component;
+    memset(component, 0, sizeof(int) * regions->sets.len);
+    for (label = 1; label < regions->sets.len; label++) {
+        int root = label_find(regions, label);
+
+        if (component[root] == 0)
+            component[root] = ++n;
+    }
+
+    if (n + 1 > regions->size) {
+        regions->size = n + 1;
+        regions->region = g_renew(region_info, regions->region, regions->size);
+    }
+    memset(regions->region, 0, sizeof(region_info) * (n + 1));
+    regions->len = n + 1;
+
+    /* Second pass: final labels and stats */
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            int index = (y * width) + x;
+            region_info *r;
+
+            if ((label = label_at(regions, index)) == 0)
+                continue;
+
+            label = component[label_find(regions, label)];
+            label_set(regions, index, label);
+            r = &regions->region[label];
+            if (r->noPixels == 0) {
+                r->minX = r->maxX = x;
+                r->minY = r->maxY = y;
+            } else {
+                r->minX = MIN(r->minX, x);
+                r->maxX = MAX(r->maxX, x);
+                r->maxY = y;
+            }
+            r->noPixels++;
+        }
+    }
+
+    for (label = 1; label <= n; label++) {
+        regions->region[label].width = regions->region[label].maxX - regions->region[label].minX + 1;
+        regions->region[label].height = regions->region[label].maxY - regions->region[label].minY + 1;
+    }
+}
+
+static void label_regions_free(label_regions_t *regions) {
+    g_free(regions->data);
+    g_free(regions->region);
+    g_free(regions->sets.parent);
+    g_free(regions->sets.component);
+    g_free(regions->sets.rank);
+}
@@ -36,7 +36,8 @@ static GdkPixbuf *pixbuf_mask(GdkPixbuf *src, GdkPixbuf *mask)
 	d_height = m_height;
 	dest = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, d_width, d_height);
 
-	g_return_val_if_fail(dest != NULL, NULL);
+	if (dest == NULL)
+		return NULL;
 
 	d_rowstride = gdk_pixbuf_get_rowstride(dest);
 	d_pix = gdk_pixbuf_get_pixels(dest);
@@ -1,6 +1,7 @@
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
 /* Includes */
 #include <ruby.h>
+#include <ruby/thread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -21,6 +22,7 @@ void Init_morandi_native(void);
 static VALUE mMorandiNative;
 static VALUE cRedEye;
 static VALUE mPixbufUtils;
+static VALUE cPipeline;
 static VALUE structRegion;
 
 
@@ -34,6 +36,9 @@ RedEye_initialize(VALUE self OPTIONAL_ATTR, VALUE __v_pixbuf OPTIONAL_ATTR, VALU
 static VALUE
 RedEye_identify_blobs(int __p_argc, VALUE *__p_argv, VALUE self);
 
+static VALUE
+RedEye_find_blobs(int __p_argc, VALUE *__p_argv, VALUE self);
+
 static VALUE
 RedEye_correct_blob(VALUE self OPTIONAL_ATTR, VALUE __v_blob_id OPTIONAL_ATTR);
 
@@ -49,6 +54,13 @@ RedEye_preview(VALUE self OPTIONAL_ATTR);
 static VALUE
 RedEye_pixbuf(VALUE self OPTIONAL_ATTR);
 
+static VALUE
+RedEye_CLASS_correct_taps(VALUE self OPTIONAL_ATTR, VALUE __v_pixbuf OPTIONAL_ATTR, VALUE __v_points OPTIONAL_ATTR,
+                          VALUE __v_options OPTIONAL_ATTR);
+
+static VALUE
+RedEye_CLASS_search_stats(VALUE self OPTIONAL_ATTR);
+
 static VALUE
 PixbufUtils_CLASS_contrast(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_adjust OPTIONAL_ATTR);
 
@@ -56,13 +68,23 @@ static VALUE
 PixbufUtils_CLASS_brightness(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_adjust OPTIONAL_ATTR);
 
 static VALUE
-PixbufUtils_CLASS_filter(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE filter OPTIONAL_ATTR,
-                         VALUE __v_divisor OPTIONAL_ATTR);
+PixbufUtils_CLASS_filter(int __p_argc, VALUE *__p_argv, VALUE self);
 
 
 static VALUE
 PixbufUtils_CLASS_rotate(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_angle OPTIONAL_ATTR);
 
+static VALUE
+PixbufUtils_CLASS_straighten(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_angle OPTIONAL_ATTR);
+
+static VALUE
+PixbufUtils_CLASS_crop_fill(int __p_argc, VALUE *__p_argv, VALUE self);
+
+static VALUE
+PixbufUtils_CLASS_border(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_colour OPTIONAL_ATTR,
+                         VALUE __v_frame OPTIONAL_ATTR, VALUE __v_clip OPTIONAL_ATTR, VALUE __v_radius OPTIONAL_ATTR,
+                         VALUE __v_origin OPTIONAL_ATTR, VALUE __v_scale OPTIONAL_ATTR);
+
 static VALUE
 PixbufUtils_CLASS_gamma(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_level OPTIONAL_ATTR);
 
@@ -72,6 +94,71 @@ PixbufUtils_CLASS_tint(int __p_argc, VALUE *__p_argv, VALUE self);
 static VALUE
 PixbufUtils_CLASS_mask(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_mask OPTIONAL_ATTR);
 
+static VALUE
+PixbufUtils_CLASS_colour_lut(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_brightness OPTIONAL_ATTR,
+                             VALUE __v_gamma OPTIONAL_ATTR, VALUE __v_contrast OPTIONAL_ATTR);
+
+static VALUE
+PixbufUtils_CLASS_contrast_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_adjust OPTIONAL_ATTR);
+
+static VALUE
+PixbufUtils_CLASS_brightness_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_adjust OPTIONAL_ATTR);
+
+static VALUE
+PixbufUtils_CLASS_gamma_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_level OPTIONAL_ATTR);
+
+static VALUE
+PixbufUtils_CLASS_icc_to_srgb_bang(int __p_argc, VALUE *__p_argv, VALUE self);
+
+static VALUE
+PixbufUtils_CLASS_load_jpeg_region(VALUE self OPTIONAL_ATTR, VALUE __v_path OPTIONAL_ATTR, VALUE __v_x OPTIONAL_ATTR,
+                                   VALUE __v_y OPTIONAL_ATTR, VALUE __v_width OPTIONAL_ATTR,
+                                   VALUE __v_height OPTIONAL_ATTR);
+
+static VALUE
+PixbufUtils_CLASS_tint_bang(int __p_argc, VALUE *__p_argv, VALUE self);
+
+static VALUE
+PixbufUtils_CLASS_colour_lut_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR,
+                                  VALUE __v_brightness OPTIONAL_ATTR, VALUE __v_gamma OPTIONAL_ATTR,
+                                  VALUE __v_contrast OPTIONAL_ATTR);
+
+static VALUE
+Pipeline_CLASS_run(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_stages OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_simd(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_simd_equals(VALUE self OPTIONAL_ATTR, VALUE __v_level OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_simd_levels(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_concurrency(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_concurrency_equals(VALUE self OPTIONAL_ATTR, VALUE __v_concurrency OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_icc_cache_size(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_icc_cache_size_equals(VALUE self OPTIONAL_ATTR, VALUE __v_size OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_icc_cache_stats(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_icc_cache_clear(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_icc_lut_after(VALUE self OPTIONAL_ATTR);
+
+static VALUE
+MorandiNative_CLASS_icc_lut_after_equals(VALUE self OPTIONAL_ATTR, VALUE __v_uses OPTIONAL_ATTR);
+
 /* Inline C code */
 
 #define PIXEL(row, channels, x)  ((pixel_t)(row + (channels * x)))
@@ -89,20 +176,57 @@ extern void Init_morandi_c(void);
 #include <unistd.h>
 #include <math.h>
 
+#include "simd.h"
+#include "parallel.h"
 #include "rotate.h"
+#include "bilinear.h"
+#include "straighten.h"
+#include "crop.h"
+#include "border.h"
 #include "gamma.h"
 #include "mask.h"
 #include "tint.h"
 #include "filter.h"
+#include "pipeline.h"
+#include "label.h"
+#include "icc.h"
+#include "jpeg.h"
 
 /*
 GdkPixbuf *pixbuf_op(GdkPixbuf *src, GdkPixbuf *dest,
 */
 
+/*
+ * Everything the kernels check about their pixbufs with g_return_val_if_fail
+ * is checked here first, while the GVL is held: without it a GLib warning
+ * would run Ruby's log handler unlocked.
+ */
+static GdkPixbuf *pixbuf_arg(VALUE value) {
+    GdkPixbuf *pixbuf;
+
+    if (NIL_P(value)) {
+        rb_raise(rb_eArgError, "Expected a pixbuf, got nil");
+    }
+    pixbuf = RVAL2GOBJ(value);
+    if (!GDK_IS_PIXBUF(pixbuf)) {
+        rb_raise(rb_eTypeError, "Expected a pixbuf");
+    }
+    if (gdk_pixbuf_get_colorspace(pixbuf) != GDK_COLORSPACE_RGB || gdk_pixbuf_get_bits_per_sample(pixbuf) != 8 ||
+        gdk_pixbuf_get_n_channels(pixbuf) != (gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3)) {
+        rb_raise(rb_eArgError, "Only 8 bit RGB or RGBA pixbufs are supported");
+    }
+
+    return pixbuf;
+}
+
+/* Kernels return NULL, quietly, only when they could not allocate their result */
 static inline VALUE
 unref_pixbuf(GdkPixbuf *pixbuf) {
     volatile VALUE pb = Qnil;
 
+    if (pixbuf == NULL) {
+        rb_raise(rb_eNoMemError, "Not enough memory for the resulting image");
+    }
     pb = GOBJ2RVAL(pixbuf);
 
     g_object_unref(pixbuf);
@@ -110,31 +234,168 @@ unref_pixbuf(GdkPixbuf *pixbuf) {
     return pb;
 }
 
+/*
+ * The pixel loops run without the GVL, so other Ruby threads can get on with
+ * their own images meanwhile. Arguments are converted before and results
+ * wrapped after; nothing in between may touch the Ruby API, which includes
+ * ALLOC/xmalloc. There is no unblocking function, so interrupts wait for the
+ * kernel to finish.
+ */
 typedef struct {
-    char red, green, blue;
-} rgb_t;
+    GdkPixbuf *src, *mask;
+    gboolean in_place;
+    int adjust, angle;
+    double degrees;
+    int x, y, width, height;
+    guint32 fill;
+    int r, g, b, alpha;
+    double level;
+    gboolean apply_level;
+    int contrast;
+    double *matrix, divisor;
+    int matrix_size, iterations;
+    const border_spec_t *border;
+    pipeline_stage_t *stages;
+    int n_stages;
+    const char *profile;
+    long profile_length;
+    int intent;
+    const char *path;
+} pixbuf_op_args_t;
+
+static void *without_gvl(void *(*func)(void *), void *args) {
+    return rb_thread_call_without_gvl(func, args, NULL, NULL);
+}
+
+/* The point operations write into src itself for the ! variants, or into a copy */
+static GdkPixbuf *op_dest(pixbuf_op_args_t *args) {
+    return args->in_place ? args->src : gdk_pixbuf_copy(args->src);
+}
+
+static void *contrast_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_adjust_contrast(args->src, op_dest(args), args->adjust);
+}
+
+static void *brightness_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_adjust_brightness(args->src, op_dest(args), args->adjust);
+}
+
+static void *filter_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_convolution_matrix_repeat(args->src, args->iterations, args->matrix_size, args->matrix,
+                                            args->divisor);
+}
+
+static void *rotate_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_rotate(args->src, (rotate_angle_t) args->angle);
+}
+
+static void *straighten_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_straighten(args->src, args->degrees);
+}
+
+static void *crop_fill_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_crop_fill(args->src, args->x, args->y, args->width, args->height, args->fill);
+}
+
+static void *border_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_border(args->src, args->border);
+}
+
+static void *pipeline_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pipeline_run(args->src, args->stages, args->n_stages);
+}
+
+static void *gamma_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_gamma(args->src, op_dest(args), args->level);
+}
+
+static void *tint_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_tint(args->src, op_dest(args), args->r, args->g, args->b, args->alpha);
+}
+
+static void *colour_lut_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_colour_lut(args->src, op_dest(args), args->adjust, args->apply_level, args->level,
+                             args->contrast);
+}
+
+static void *icc_to_srgb_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return GINT_TO_POINTER(pixbuf_icc_to_srgb(args->src, args->profile, args->profile_length, args->intent));
+}
+
+static void *load_jpeg_region_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_load_jpeg_region(args->path, args->x, args->y, args->width, args->height);
+}
+
+static void *mask_without_gvl(void *data) {
+    pixbuf_op_args_t *args = data;
+    return pixbuf_mask(args->src, args->mask);
+}
 
 typedef struct {
-    int minX, maxX, minY, maxY;
-    int width, height;
-    int noPixels, mergeWith;
-} region_info;
+    char red, green, blue;
+} rgb_t;
 
 typedef struct {
     struct {
         int minX, maxX, minY, maxY;
         int width, height;
     } area;
-    struct {
-        int *data;
-        region_info *region;
-        int len, size;
-    } regions;
-    int *mask;
+    label_regions_t regions;
+    /* Pixels that met the threshold, one byte each; the last row and column of the area are never marked */
+    guchar *mask;
     GdkPixbuf *pixbuf, *preview;
 } redeyeop_t;
 
 #define MIN_RED_VAL 20
+/* Default share of its bounds a blob must fill to count as an eye */
+#define RED_AREA_DENSITY_THRESHOLD 0.3
+
+/*
+ * A pixel is red when r > green_sensitivity * g, r > blue_sensitivity * b
+ * and r > min_red_val. For each green and blue level, the least red that
+ * beats it is worked out once, so the test is three integer compares.
+ */
+typedef struct {
+    short green[256], blue[256];
+    int min_red;
+} redeye_threshold_t;
+
+/* The least whole r with r > level, or 256 if there is none */
+static short redeye_threshold_level(double level) {
+    if (!(level < 256.0))
+        return 256;
+    if (level < 0.0)
+        return 0;
+    return (short) floor(level) + 1;
+}
+
+static void redeye_threshold_init(redeye_threshold_t *t, double green_sensitivity, double blue_sensitivity,
+                                  int min_red_val) {
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        t->green[i] = redeye_threshold_level(green_sensitivity * (double) i);
+        t->blue[i] = redeye_threshold_level(blue_sensitivity * (double) i);
+    }
+    t->min_red = min_red_val;
+}
+
+static inline gboolean redeye_threshold_met(const redeye_threshold_t *t, const guchar *pixel) {
+    return (pixel[0] >= t->green[pixel[1]]) && (pixel[0] >= t->blue[pixel[2]]) && (pixel[0] > t->min_red);
+}
 
 static void identify_possible_redeye_pixels(redeyeop_t *op,
                                             double green_sensitivity, double blue_sensitivity,
@@ -142,8 +403,10 @@ static void identify_possible_redeye_pixels(redeyeop_t *op,
     guchar *data = gdk_pixbuf_get_pixels(op->pixbuf);
     int rowstride = gdk_pixbuf_get_rowstride(op->pixbuf);
     int pixWidth = gdk_pixbuf_get_has_alpha(op->pixbuf) ? 4 : 3;
+    redeye_threshold_t threshold;
 
     int y, ry = 0, x, rx = 0;
+    redeye_threshold_init(&threshold, green_sensitivity, blue_sensitivity, min_red_val);
     for (y = op->area.minY; y < op->area.maxY; y++) {
         guchar *thisLine = data + (rowstride * y);
         guchar *pixel;
@@ -152,23 +415,7 @@ static void identify_possible_redeye_pixels(redeyeop_t *op,
         rx = 0;
 
         for (x = op->area.minX; x < op->area.maxX; x++) {
-
-            int r, g, b;
-
-            r = pixel[0];
-            g = pixel[1];
-            b = pixel[2];
-
-            gboolean threshMet;
-
-            threshMet = (((double) r) > (green_sensitivity * (double) g)) &&
-                        (((double) r) > (blue_sensitivity * (double) b)) &&
-                        (r > min_red_val);
-
-            if (threshMet)
-                op->mask[rx + ry] = r;
-            else
-                op->mask[rx + ry] = 0; /* MEMZERO should have done its job ? */
+            op->mask[rx + ry] = redeye_threshold_met(&threshold, pixel);
 
             pixel += pixWidth;
             rx++;
@@ -178,144 +425,10 @@ static void identify_possible_redeye_pixels(redeyeop_t *op,
     }
 }
 
-inline int group_at(redeyeop_t *op, int px, int py) {
-    int index, region;
-
-    if (px < 0 || py < 0)
-        return 0;
-
-    index = px + (py * op->area.width);
-
-    if (index < 0)
-        return 0;
-    if (index > (op->area.width * op->area.height))
-        return 0;
-
-    region = op->regions.data[index];
-    if (region > 0) {
-        if (op->regions.region[region].mergeWith) {
-            return op->regions.region[region].mergeWith;
-        } else {
-            return region;
-        }
-    } else {
-        return 0;
-    }
-}
-
-#define group_for(x, y) group_at(op, x, y)
-
 static void identify_blob_groupings(redeyeop_t *op) {
-    volatile int next_blob_id = 1, blob_id, y, x;
-
-    for (y = 0; y < op->area.height; y++) {
-        for (x = 0; x < op->area.width; x++) {
-            if (op->mask[x + (y * op->area.width)] > 0) {
-                gboolean existing = FALSE;
-                int sx, sy, group = 0;
-                // Target pixel is true
-                blob_id = 0;
-
-                for (sy = y; sy >= y - 1; sy--) {
-                    sx = (sy == y) ? x : x + 1;
-                    for (; sx >= (x - 1); sx--) {
-                        /*if ((sx >= x) && (sy >= y))
-                                goto blob_scan_done;*/
-
-                        if (sx >= 0 && sy >= 0)
-                            group = group_for(sx, sy);
-
-                        if (group) {
-                            existing = TRUE;
-                            if (blob_id) {
-                                int target = MIN(blob_id, group);
-                                int from = MAX(blob_id, group);
-
-                                if (op->regions.region[target].mergeWith > 0) {
-                                    // Already merged
-                                    target = op->regions.region[target].mergeWith;
-                                }
-                                op->regions.region[from].mergeWith = target;
-
-                                // Merge blob_id & group
-                            }
-                            blob_id = group;
-                        }
-                    }
-                }
-
-                if (blob_id == 0) { // Allocate new group
-                    blob_id = next_blob_id;
-                    op->regions.region[blob_id].minX = x;
-                    op->regions.region[blob_id].maxX = x;
-                    op->regions.region[blob_id].minY = y;
-                    op->regions.region[blob_id].maxY = y;
-                    op->regions.region[blob_id].width = 1;
-                    op->regions.region[blob_id].height = 1;
-                    op->regions.region[blob_id].noPixels = 1;
-                    op->regions.region[blob_id].mergeWith = 0;
-
-                    next_blob_id++;
-                    op->regions.len = next_blob_id;
-
-                    if (next_blob_id >= op->regions.size) {
-                        int extra, new_size;
-
-                        /*
-                         * Realloc in increasingly large chunks to reduce memory fragmentation
-                         */
-                        extra = op->regions.size;
-                        new_size = op->regions.size + extra;
-
-                        REALLOC_N(op->regions.region, region_info, new_size);
-
-                        op->regions.size = new_size;
-                    }
-                }
-
-                if (existing) {
-                    op->regions.region[blob_id].minX = MIN(x, op->regions.region[blob_id].minX);
-                    op->regions.region[blob_id].maxX = MAX(x, op->regions.region[blob_id].maxX);
-                    op->regions.region[blob_id].minY = MIN(y, op->regions.region[blob_id].minY);
-                    op->regions.region[blob_id].maxY = MAX(y, op->regions.region[blob_id].maxY);
-                    op->regions.region[blob_id].width = op->regions.region[blob_id].maxX -
-                                                        op->regions.region[blob_id].minX + 1;
-                    op->regions.region[blob_id].height = op->regions.region[blob_id].maxY -
-                                                         op->regions.region[blob_id].minY + 1;
-                    op->regions.region[blob_id].noPixels++;
-                }
-
-                op->regions.data[x + (y * op->area.width)] = blob_id;
-            }
-        }
-    }
-    /*FILE *fp = fopen("regions.txt","w");*/
-    for (y = 0; y < op->area.height; y++) {
-        for (x = 0; x < op->area.width; x++) {
-            int g = group_at(op, x, y); // Returns the merged group...
-            op->regions.data[x + (y * op->area.width)] = g;
-            /*
-            if (op->regions.len <= 0xf || 1)
-            {
-            if (g == 0)
-                fprintf(fp, " ");
-            else
-                fprintf(fp, "%x", g);
-            }
-            else
-            {
-            if (g == 0)
-                fprintf(fp, "  ");
-            else
-                fprintf(fp, "%x ", g);
-            }*/
-        }
-        /*fprintf(fp, "\n");*/
-    }
-    /*fclose(fp);*/
+    label_components(&op->regions, op->mask, op->area.width, op->area.height);
 }
 
-#define NO_REGIONS_DEFAULT 20
 #define MIN_ID 1
 
 static redeyeop_t *new_redeye(void) {
@@ -325,16 +438,8 @@ static redeyeop_t *new_redeye(void) {
 }
 
 static void free_redeye(redeyeop_t *ptr) {
-    if (ptr->mask)
-        free(ptr->mask);
-
-    if (ptr->regions.data) {
-        free(ptr->regions.data);
-    }
-
-    if (ptr->regions.region) {
-        free(ptr->regions.region);
-    }
+    g_free(ptr->mask);
+    label_regions_free(&ptr->regions);
 
     if (ptr->pixbuf) {
         g_object_unref(ptr->pixbuf);
@@ -347,42 +452,105 @@ static void free_redeye(redeyeop_t *ptr) {
     free(ptr);
 }
 
-static gboolean in_region(redeyeop_t *op, int x, int y, int blob_id) {
-    int index;
+/*
+ * Blobs are blended in with a feathered edge: fully inside the blob, and
+ * otherwise by the share of the 5x5 window around a pixel that lies in it.
+ * Those shares are summed once per blob from a summed-area table of its
+ * pixels, and blending works in whole levels out of FEATHER_FULL.
+ */
+#define FEATHER_RADIUS 2
+#define FEATHER_FULL 25
 
-    if (x < op->area.minX || x > op->area.maxX ||
-        y < op->area.minY || y > op->area.maxY)
-        return FALSE;
+typedef struct {
+    /* Image position and size of the map, which covers every pixel the blob feathers into */
+    int x0, y0, width, height;
+    guchar *alpha;
+} feather_map_t;
+
+/* Sum of the window x0..x1-1, y0..y1-1 of a summed-area table with the given stride */
+static inline int feather_window(const int *sat, int stride, int x0, int y0, int x1, int y1) {
+    return sat[(y1 * stride) + x1] - sat[(y0 * stride) + x1] - sat[(y1 * stride) + x0] + sat[(y0 * stride) + x0];
+}
 
-    index = (x - op->area.minX) + ((y - op->area.minY) * op->area.width);
+static void feather_map_init(feather_map_t *map, redeyeop_t *op, int blob_id) {
+    const region_info *r = &op->regions.region[blob_id];
+    /* In the blob's own coordinates, relative to the area; the feather can reach past the area */
+    int mx0 = r->minX - FEATHER_RADIUS, my0 = r->minY - FEATHER_RADIUS;
+    int width = r->width + (2 * FEATHER_RADIUS), height = r->height + (2 * FEATHER_RADIUS), stride = width + 1;
+    int *sat, x, y;
 
-    return op->regions.data[index] == blob_id;
-}
+    /* sat[(y + 1) * stride + x + 1] counts the blob's pixels above and left of (x, y), inclusive */
+    sat = g_new0(int, stride * (height + 1));
+    for (y = 0; y < height; y++) {
+        int ay = my0 + y, row = 0;
 
-static double alpha_level_for_pixel(redeyeop_t *op, int x, int y, int blob_id) {
-    int j = 0, c = 0, xm, ym;
+        for (x = 0; x < width; x++) {
+            int ax = mx0 + x;
 
-    if (in_region(op, x, y, blob_id))
-        return 1.0;
+            if (ax >= 0 && ay >= 0 && ax < op->area.width && ay < op->area.height)
+                row += (label_at(&op->regions, (ay * op->area.width) + ax) == blob_id);
+            sat[((y + 1) * stride) + x + 1] = sat[(y * stride) + x + 1] + row;
+        }
+    }
 
-    for (xm = -2; xm <= 2; xm++) {
-        for (ym = -2; ym <= 2; ym++) {
-            c++;
-            if (xm == 0 && ym == 0)
-                continue;
-            if (in_region(op, x + xm, y + ym, blob_id))
-                j++;
+    map->x0 = op->area.minX + mx0;
+    map->y0 = op->area.minY + my0;
+    map->width = width;
+    map->height = height;
+    map->alpha = g_new(guchar, width * height);
+
+    for (y = 0; y < height; y++) {
+        int wy0 = MAX(y - FEATHER_RADIUS, 0), wy1 = MIN(y + FEATHER_RADIUS, height - 1) + 1;
+
+        for (x = 0; x < width; x++) {
+            int wx0 = MAX(x - FEATHER_RADIUS, 0), wx1 = MIN(x + FEATHER_RADIUS, width - 1) + 1;
+
+            if (feather_window(sat, stride, x, y, x + 1, y + 1))
+                map->alpha[(y * width) + x] = FEATHER_FULL;
+            else
+                map->alpha[(y * width) + x] = feather_window(sat, stride, wx0, wy0, wx1, wy1);
         }
     }
 
-    return ((double) j) / ((double) c);
+    g_free(sat);
 }
 
-static unsigned char col(double val) {
-    if (val < 0) return 0;
-    if (val > 255) return 255;
-    return val;
+/* Limits x0..x1, y0..y1 (inclusive, in image coordinates) to the map; FALSE if nothing is left */
+static gboolean feather_map_clip(const feather_map_t *map, int *x0, int *y0, int *x1, int *y1) {
+    *x0 = MAX(*x0, map->x0);
+    *y0 = MAX(*y0, map->y0);
+    *x1 = MIN(*x1, map->x0 + map->width - 1);
+    *y1 = MIN(*y1, map->y0 + map->height - 1);
 
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+/* Blends the feathered blob towards colour over x0..x1, y0..y1 of pixbuf, which is at (dx, dy) in the image */
+static void feather_blend(const feather_map_t *map, GdkPixbuf *pixbuf, int dx, int dy, int x0, int y0, int x1,
+                          int y1, int colour) {
+    guchar *data = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int pixWidth = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
+    int hr = (colour >> 16) & 0xff, hg = (colour >> 8) & 0xff, hb = colour & 0xff;
+    int x, y;
+
+    if (!feather_map_clip(map, &x0, &y0, &x1, &y1))
+        return;
+
+    for (y = y0; y <= y1; y++) {
+        const guchar *alpha = map->alpha + ((y - map->y0) * map->width) - map->x0;
+        guchar *pixel = data + (rowstride * (y - dy)) + ((x0 - dx) * pixWidth);
+
+        for (x = x0; x <= x1; x++, pixel += pixWidth) {
+            int a = alpha[x], rest = FEATHER_FULL - a;
+
+            if (a > 0) {
+                pixel[0] = ((rest * pixel[0]) + (a * hr)) / FEATHER_FULL;
+                pixel[1] = ((rest * pixel[1]) + (a * hg)) / FEATHER_FULL;
+                pixel[2] = ((rest * pixel[2]) + (a * hb)) / FEATHER_FULL;
+            }
+        }
+    }
 }
 
 static GdkPixbuf *redeye_preview(redeyeop_t *op, gboolean reset) {
@@ -412,143 +580,813 @@ static GdkPixbuf *redeye_preview(redeyeop_t *op, gboolean reset) {
     return op->preview;
 }
 
-static void desaturate_blob(redeyeop_t *op, int blob_id) {
-    int y, x;
+/*
+ * A blob's correction, worked out from the labels alone so it can be kept
+ * and applied after the labels are gone or the pixels around it changed.
+ */
+typedef struct {
+    feather_map_t map;
+    /* The pixels it touches, inclusive, in image coordinates */
     int minX, minY, maxX, maxY;
+} desaturation_t;
 
-    minY = MAX(0, op->area.minY + op->regions.region[blob_id].minY - 1);
-    maxY = MIN(op->area.maxY + op->regions.region[blob_id].maxY + 1,
-               gdk_pixbuf_get_height(op->pixbuf) - 1);
-    minX = MAX(0, op->area.minX + op->regions.region[blob_id].minX - 1);
-    maxX = MIN(op->area.maxX + op->regions.region[blob_id].maxX + 1,
-               gdk_pixbuf_get_width(op->pixbuf) - 1);
+static void desaturation_init(desaturation_t *fix, redeyeop_t *op, int blob_id) {
+    fix->minY = MAX(0, op->area.minY + op->regions.region[blob_id].minY - 1);
+    fix->maxY = MIN(op->area.maxY + op->regions.region[blob_id].maxY + 1,
+                    gdk_pixbuf_get_height(op->pixbuf) - 1);
+    fix->minX = MAX(0, op->area.minX + op->regions.region[blob_id].minX - 1);
+    fix->maxX = MIN(op->area.maxX + op->regions.region[blob_id].maxX + 1,
+                    gdk_pixbuf_get_width(op->pixbuf) - 1);
 
-    guchar *data = gdk_pixbuf_get_pixels(op->pixbuf);
-    int rowstride = gdk_pixbuf_get_rowstride(op->pixbuf);
-    int pixWidth = gdk_pixbuf_get_has_alpha(op->pixbuf) ? 4 : 3;
+    feather_map_init(&fix->map, op, blob_id);
+}
 
-    for (y = minY; y <= maxY; y++) {
-        guchar *thisLine = data + (rowstride * y);
-        guchar *pixel;
+/* The part of the image the correction changes, inclusive; FALSE if it changes nothing */
+static gboolean desaturation_bounds(const desaturation_t *fix, int *minX, int *minY, int *maxX, int *maxY) {
+    *minX = fix->minX;
+    *minY = fix->minY;
+    *maxX = fix->maxX;
+    *maxY = fix->maxY;
 
-        pixel = thisLine + (minX * pixWidth);
+    return feather_map_clip(&fix->map, minX, minY, maxX, maxY);
+}
 
-        for (x = minX; x <= maxX; x++) {
+static void desaturation_apply(const desaturation_t *fix, GdkPixbuf *pixbuf) {
+    const feather_map_t *map = &fix->map;
+    int y, x;
+    int minX, minY, maxX, maxY;
 
-            double alpha = alpha_level_for_pixel(op, x, y, blob_id);
-            int r, g, b, grey;
+    guchar *data = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int pixWidth = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
 
-            r = pixel[0];
-            g = pixel[1];
-            b = pixel[2];
+    if (desaturation_bounds(fix, &minX, &minY, &maxX, &maxY)) {
+        for (y = minY; y <= maxY; y++) {
+            const guchar *alpha = map->alpha + ((y - map->y0) * map->width) - map->x0;
+            guchar *pixel = data + (rowstride * y) + (minX * pixWidth);
 
-            if (alpha > 0) {
-                grey = alpha * ((double) (5 * (double) r + 60 * (double) g + 30 * (double) b)) / 100.0 +
-                       (1 - alpha) * r;
+            for (x = minX; x <= maxX; x++, pixel += pixWidth) {
+                int a = alpha[x], rest = FEATHER_FULL - a;
+                int r, g, b, grey;
 
-                pixel[0] = col((grey * alpha) + (1 - alpha) * r);
-                pixel[1] = col((grey * alpha) + (1 - alpha) * g);
-                pixel[2] = col((grey * alpha) + (1 - alpha) * b);
-            }
+                r = pixel[0];
+                g = pixel[1];
+                b = pixel[2];
 
-            pixel += pixWidth;
+                if (a > 0) {
+                    /* The blend of the pixel with its grey, itself blended again */
+                    grey = ((a * ((5 * r) + (60 * g) + (30 * b))) + (100 * rest * r)) / (100 * FEATHER_FULL);
+
+                    pixel[0] = ((grey * a) + (rest * r)) / FEATHER_FULL;
+                    pixel[1] = ((grey * a) + (rest * g)) / FEATHER_FULL;
+                    pixel[2] = ((grey * a) + (rest * b)) / FEATHER_FULL;
+                }
+            }
         }
     }
+}
+
+static void desaturate_blob(redeyeop_t *op, int blob_id) {
+    desaturation_t fix;
 
+    desaturation_init(&fix, op, blob_id);
+    desaturation_apply(&fix, op->pixbuf);
+    g_free(fix.map.alpha);
 }
 
 static void highlight_blob(redeyeop_t *op, int blob_id, int colour) {
-    int y, x;
+    feather_map_t map;
+
+    feather_map_init(&map, op, blob_id);
+    feather_blend(&map, op->pixbuf, 0, 0, MAX(0, op->area.minX - 1), MAX(0, op->area.minY - 1),
+                  MIN(op->area.maxX + 1, gdk_pixbuf_get_width(op->pixbuf) - 1),
+                  MIN(op->area.maxY + 1, gdk_pixbuf_get_height(op->pixbuf) - 1), colour);
+    g_free(map.alpha);
+}
+
+static void preview_blob(redeyeop_t *op, int blob_id, int colour, gboolean reset_preview) {
+    feather_map_t map;
+
+    redeye_preview(op, reset_preview);
+
+    feather_map_init(&map, op, blob_id);
+    feather_blend(&map, op->preview, op->area.minX, op->area.minY, op->area.minX, op->area.minY,
+                  op->area.minX + gdk_pixbuf_get_width(op->preview) - 1,
+                  op->area.minY + gdk_pixbuf_get_height(op->preview) - 1, colour);
+    g_free(map.alpha);
+}
+
+typedef struct {
+    redeyeop_t *op;
+    double green_sensitivity, blue_sensitivity;
+    int min_red_val;
+    int blob_id, colour;
+    gboolean reset_preview;
+} redeye_args_t;
+
+/* Marks and labels the red pixels of the area into op's mask, which must have room for it */
+static void redeye_identify(redeyeop_t *op, double green_sensitivity, double blue_sensitivity, int min_red_val) {
+    MEMZERO(op->mask, guchar, op->area.width * op->area.height);
+    identify_possible_redeye_pixels(op, green_sensitivity, blue_sensitivity, min_red_val);
+    identify_blob_groupings(op);
+}
+
+static void *identify_blobs_without_gvl(void *data) {
+    redeye_args_t *args = data;
+    redeyeop_t *op = args->op;
+
+    /* GLib allocations, made on first use and kept for later calls, as this runs without the GVL */
+    if (op->mask == NULL)
+        op->mask = g_new(guchar, op->area.width * op->area.height);
+    redeye_identify(op, args->green_sensitivity, args->blue_sensitivity, args->min_red_val);
+    return NULL;
+}
+
+static void *correct_blob_without_gvl(void *data) {
+    redeye_args_t *args = data;
+    desaturate_blob(args->op, args->blob_id);
+    return NULL;
+}
+
+static void *highlight_blob_without_gvl(void *data) {
+    redeye_args_t *args = data;
+    highlight_blob(args->op, args->blob_id, args->colour);
+    return NULL;
+}
+
+static void *preview_blob_without_gvl(void *data) {
+    redeye_args_t *args = data;
+    preview_blob(args->op, args->blob_id, args->colour, args->reset_preview);
+    return NULL;
+}
+
+/*
+ * Several taps at once, for MorandiNative::RedEye.correct_taps. Search
+ * areas that overlap are merged, then scanned and labelled together. Each
+ * tap takes the last blob, in scan order, that lies wholly in its own area
+ * and passes the size and shape tests, as TapRedEye picked from a RedEye of
+ * just that area. Blobs an earlier tap took are skipped, since a scan after
+ * correcting them would no longer find them red. A blob that runs over the
+ * edge of a tap's area would have been cut there by a scan of that area
+ * alone, so a group with one is done tap by tap, as before. So is a group
+ * where correcting one blob feathers into pixels nearby enough to change
+ * whether they are red, as a later scan would then find different blobs.
+ *
+ * With a proxy scale, an area is first split into cells of that many
+ * pixels square, and only the middle pixel of each is checked for red.
+ * Runs of touching red cells are labelled on that small grid, and the
+ * bounds of each run are then labelled at full size. A box with red on an
+ * edge inside the area grows past it and is labelled again, and boxes that
+ * grow into each other are merged, so each blob found is whole and found
+ * once, as a full scan would find it. The edge of the area is checked in
+ * full, as a blob it cuts can leave just a sliver inside. Most of a large
+ * area is skin and background, which is then only sampled and never
+ * labelled. Blobs that cover no sampled pixel and lie outside every box,
+ * such as eyes less than about proxy pixels across, are not found.
+ */
+typedef struct {
+    double green_sensitivity, blue_sensitivity;
+    int min_red_val, min_pixels;
+    double min_ratio, min_density;
+    /* Size of the cells sampled for red before labelling; 1 labels the whole area */
+    int proxy;
+} redeye_options_t;
+
+typedef struct {
+    /* Search area, scanned from min up to but not including max */
     int minX, minY, maxX, maxY;
-    int hr, hg, hb;
+    /* Index of the merged area it is searched in */
+    int group;
+} redeye_tap_t;
 
-    hr = (colour >> 16) & 0xff;
-    hg = (colour >> 8) & 0xff;
-    hb = (colour) & 0xff;
+typedef struct {
+    GdkPixbuf *pixbuf;
+    redeye_tap_t *taps;
+    int n_taps;
+    redeye_options_t options;
+} redeye_taps_args_t;
 
-    minY = MAX(0, op->area.minY - 1);
-    maxY = MIN(op->area.maxY + 1, gdk_pixbuf_get_height(op->pixbuf) - 1);
-    minX = MAX(0, op->area.minX - 1);
-    maxX = MIN(op->area.maxX + 1, gdk_pixbuf_get_width(op->pixbuf) - 1);
+typedef struct {
+    /* Bounds in image coordinates, and pixel count */
+    region_info r;
+    /* Column of its first pixel in a raster scan, which with r.minY orders blobs as a scan of the whole area would */
+    int firstX;
+    /* The area it was labelled in, and its label there */
+    redeye_tap_t area;
+    int id;
+} redeye_blob_t;
+
+/* Totals over every correct_taps call, for RedEye.search_stats */
+static struct {
+    GMutex lock;
+    guint64 sampled, thresholded;
+} redeye_search_stats;
 
-    guchar *data = gdk_pixbuf_get_pixels(op->pixbuf);
-    int rowstride = gdk_pixbuf_get_rowstride(op->pixbuf);
-    int pixWidth = gdk_pixbuf_get_has_alpha(op->pixbuf) ? 4 : 3;
+typedef struct {
+    redeyeop_t op;
+    const redeye_options_t *options;
+    /* Blobs of two or more pixels found by the last search, in scan order */
+    redeye_blob_t *blobs;
+    int n_blobs, blobs_size;
+    /* Cells of the proxy scan with a red middle pixel, and their connected runs */
+    guchar *blocks;
+    int blocks_width, blocks_height;
+    label_regions_t runs;
+    /* Parts of the area labelled at full size, around the runs */
+    redeye_tap_t *boxes;
+    int n_boxes, boxes_size;
+    /* Pixels checked for red on the proxy, and at full size */
+    guint64 sampled, thresholded;
+} redeye_search_t;
+
+static gboolean region_squareish(const region_info *r, double min_ratio, double min_density) {
+    double ratio = (double) MIN(r->width, r->height) / (double) MAX(r->width, r->height);
+    double density = (double) r->noPixels / (double) (r->width * r->height);
+
+    return (ratio >= min_ratio) && (density > min_density);
+}
 
-    for (y = minY; y <= maxY; y++) {
-        guchar *thisLine = data + (rowstride * y);
-        guchar *pixel;
+/* Whether a blob is big and round enough to be an eye; single pixels are CCD noise */
+static gboolean redeye_eyelike(const region_info *r, const redeye_options_t *options) {
+    return r->noPixels >= MAX(options->min_pixels, 2) && region_squareish(r, options->min_ratio, options->min_density);
+}
 
-        pixel = thisLine + (minX * pixWidth);
+/* Merges the areas of taps that overlap, directly or through others, into groups; returns how many */
+static int redeye_group_taps(redeye_tap_t *taps, int n_taps, redeye_tap_t *groups) {
+    int n_groups = 0, i, j, k;
+    gboolean merged;
 
-        for (x = minX; x <= maxX; x++) {
+    for (i = 0; i < n_taps; i++) {
+        groups[n_groups] = taps[i];
+        taps[i].group = n_groups++;
+    }
 
-            double alpha = alpha_level_for_pixel(op, x, y, blob_id);
-            int r, g, b;
+    do {
+        merged = FALSE;
+        for (i = 0; i < n_groups; i++) {
+            for (j = i + 1; j < n_groups; j++) {
+                if (groups[i].minX >= groups[j].maxX || groups[j].minX >= groups[i].maxX ||
+                    groups[i].minY >= groups[j].maxY || groups[j].minY >= groups[i].maxY)
+                    continue;
+
+                groups[i].minX = MIN(groups[i].minX, groups[j].minX);
+                groups[i].minY = MIN(groups[i].minY, groups[j].minY);
+                groups[i].maxX = MAX(groups[i].maxX, groups[j].maxX);
+                groups[i].maxY = MAX(groups[i].maxY, groups[j].maxY);
+
+                /* j's taps join i, and the last group moves into j's place */
+                for (k = 0; k < n_taps; k++) {
+                    if (taps[k].group == j)
+                        taps[k].group = i;
+                    else if (taps[k].group == n_groups - 1)
+                        taps[k].group = j;
+                }
+                groups[j] = groups[--n_groups];
+                merged = TRUE;
+                j--;
+            }
+        }
+    } while (merged);
+
+    return n_groups;
+}
+
+static void redeye_set_area(redeyeop_t *op, const redeye_tap_t *area, const redeye_options_t *options) {
+    op->area.minX = area->minX;
+    op->area.minY = area->minY;
+    op->area.maxX = area->maxX;
+    op->area.maxY = area->maxY;
+    op->area.width = op->area.maxX - op->area.minX + 1;
+    op->area.height = op->area.maxY - op->area.minY + 1;
+
+    op->mask = g_renew(guchar, op->mask, op->area.width * op->area.height);
+    redeye_identify(op, options->green_sensitivity, options->blue_sensitivity, options->min_red_val);
+}
 
-            r = (pixel[0]);
-            g = (pixel[1]);
-            b = (pixel[2]);
+/* Adds the blobs labelled in op */
+static void redeye_search_add(redeye_search_t *search) {
+    redeyeop_t *op = &search->op;
+    int id;
 
-            if (alpha > 0) {
+    for (id = MIN_ID; id < op->regions.len; id++) {
+        const region_info *r = &op->regions.region[id];
+        redeye_blob_t *blob;
+        int row = r->minY * op->area.width, x = r->minX;
+
+        if (r->noPixels < 2)
+            continue;
+
+        while (label_at(&op->regions, row + x) != id)
+            x++;
+
+        if (search->n_blobs == search->blobs_size) {
+            search->blobs_size = MAX(search->blobs_size * 2, LABEL_SETS_DEFAULT);
+            search->blobs = g_renew(redeye_blob_t, search->blobs, search->blobs_size);
+        }
+
+        blob = &search->blobs[search->n_blobs++];
+        blob->r = *r;
+        blob->r.minX += op->area.minX;
+        blob->r.maxX += op->area.minX;
+        blob->r.minY += op->area.minY;
+        blob->r.maxY += op->area.minY;
+        blob->firstX = op->area.minX + x;
+        blob->area.minX = op->area.minX;
+        blob->area.minY = op->area.minY;
+        blob->area.maxX = op->area.maxX;
+        blob->area.maxY = op->area.maxY;
+        blob->id = id;
+    }
+}
+
+static int redeye_blob_compare(const void *a, const void *b) {
+    const redeye_blob_t *ba = a, *bb = b;
+
+    if (ba->r.minY != bb->r.minY)
+        return ba->r.minY - bb->r.minY;
+    return ba->firstX - bb->firstX;
+}
+
+/* Labels part of the image at full size */
+static void redeye_search_label(redeye_search_t *search, const redeye_tap_t *area) {
+    search->thresholded += (guint64) (area->maxX - area->minX) * (area->maxY - area->minY);
+    redeye_set_area(&search->op, area, search->options);
+}
 
-                pixel[0] = col((1 - alpha) * r + (alpha * hr));
-                pixel[1] = col((1 - alpha) * g + (alpha * hg));
-                pixel[2] = col((1 - alpha) * b + (alpha * hb));
+/*
+ * Marks the cells of area whose middle pixel is red, and those with red on
+ * the edge of the area, where a blob the area cuts can be a sliver
+ */
+static void redeye_search_cells(redeye_search_t *search, const redeye_tap_t *area) {
+    GdkPixbuf *pixbuf = search->op.pixbuf;
+    const redeye_options_t *options = search->options;
+    guchar *data = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int pixWidth = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
+    int scale = options->proxy, bx, by, x, y;
+    redeye_threshold_t threshold;
+
+    redeye_threshold_init(&threshold, options->green_sensitivity, options->blue_sensitivity, options->min_red_val);
+
+    search->blocks_width = ((area->maxX - area->minX) + scale - 1) / scale;
+    search->blocks_height = ((area->maxY - area->minY) + scale - 1) / scale;
+    search->blocks = g_renew(guchar, search->blocks, search->blocks_width * search->blocks_height);
+    search->sampled += (guint64) search->blocks_width * search->blocks_height;
+
+    for (by = 0; by < search->blocks_height; by++) {
+        guchar *blocks = search->blocks + (by * search->blocks_width);
+        int y0 = area->minY + (by * scale);
+        const guchar *line;
+
+        y = y0 + ((MIN(y0 + scale, area->maxY) - y0) / 2);
+        line = data + (rowstride * y);
+        for (bx = 0; bx < search->blocks_width; bx++) {
+            int x0 = area->minX + (bx * scale);
+
+            x = x0 + ((MIN(x0 + scale, area->maxX) - x0) / 2);
+            blocks[bx] = redeye_threshold_met(&threshold, line + (x * pixWidth));
+        }
+    }
+
+    search->sampled += 2 * (guint64) ((area->maxX - area->minX) + (area->maxY - area->minY));
+    for (x = area->minX; x < area->maxX; x++) {
+        bx = (x - area->minX) / scale;
+        if (redeye_threshold_met(&threshold, data + (rowstride * area->minY) + (x * pixWidth)))
+            search->blocks[bx] = 1;
+        if (redeye_threshold_met(&threshold, data + (rowstride * (area->maxY - 1)) + (x * pixWidth)))
+            search->blocks[((search->blocks_height - 1) * search->blocks_width) + bx] = 1;
+    }
+    for (y = area->minY; y < area->maxY; y++) {
+        by = (y - area->minY) / scale;
+        if (redeye_threshold_met(&threshold, data + (rowstride * y) + (area->minX * pixWidth)))
+            search->blocks[by * search->blocks_width] = 1;
+        if (redeye_threshold_met(&threshold, data + (rowstride * y) + ((area->maxX - 1) * pixWidth)))
+            search->blocks[(by * search->blocks_width) + search->blocks_width - 1] = 1;
+    }
+}
+
+/* The part of the area a run of cells covers */
+static void redeye_run_bounds(const redeye_search_t *search, const redeye_tap_t *area, int run, redeye_tap_t *bounds) {
+    const region_info *r = &search->runs.region[run];
+    int scale = search->options->proxy;
+
+    bounds->minX = area->minX + (r->minX * scale);
+    bounds->minY = area->minY + (r->minY * scale);
+    bounds->maxX = MIN(area->minX + ((r->maxX + 1) * scale), area->maxX);
+    bounds->maxY = MIN(area->minY + ((r->maxY + 1) * scale), area->maxY);
+}
+
+/*
+ * Grows a box just labelled past each of its edges that red reaches but the
+ * area does not end at, by its own size or the proxy scale if more, so long
+ * blobs take few steps; returns whether it grew.
+ */
+static gboolean redeye_box_grow(const redeye_search_t *search, const redeye_tap_t *area, redeye_tap_t *box) {
+    const redeyeop_t *op = &search->op;
+    int step_x = MAX(box->maxX - box->minX, search->options->proxy);
+    int step_y = MAX(box->maxY - box->minY, search->options->proxy);
+    int last_x = box->maxX - box->minX - 1, last_y = box->maxY - box->minY - 1;
+    redeye_tap_t grown = *box;
+    int id;
+
+    for (id = MIN_ID; id < op->regions.len; id++) {
+        const region_info *r = &op->regions.region[id];
+
+        if (r->minX == 0)
+            grown.minX = MAX(box->minX - step_x, area->minX);
+        if (r->minY == 0)
+            grown.minY = MAX(box->minY - step_y, area->minY);
+        if (r->maxX == last_x)
+            grown.maxX = MIN(box->maxX + step_x, area->maxX);
+        if (r->maxY == last_y)
+            grown.maxY = MIN(box->maxY + step_y, area->maxY);
+    }
+
+    if (grown.minX == box->minX && grown.minY == box->minY && grown.maxX == box->maxX && grown.maxY == box->maxY)
+        return FALSE;
+    *box = grown;
+    return TRUE;
+}
+
+/* Merges boxes that overlap into one covering both; returns whether any did */
+static gboolean redeye_boxes_merge(redeye_search_t *search) {
+    redeye_tap_t *boxes = search->boxes;
+    gboolean merged = FALSE;
+    int i, j;
+
+    for (i = 0; i < search->n_boxes; i++) {
+        for (j = i + 1; j < search->n_boxes; j++) {
+            if (boxes[i].minX >= boxes[j].maxX || boxes[j].minX >= boxes[i].maxX ||
+                boxes[i].minY >= boxes[j].maxY || boxes[j].minY >= boxes[i].maxY)
+                continue;
+
+            boxes[i].minX = MIN(boxes[i].minX, boxes[j].minX);
+            boxes[i].minY = MIN(boxes[i].minY, boxes[j].minY);
+            boxes[i].maxX = MAX(boxes[i].maxX, boxes[j].maxX);
+            boxes[i].maxY = MAX(boxes[i].maxY, boxes[j].maxY);
+            boxes[j] = boxes[--search->n_boxes];
+            merged = TRUE;
+            /* i may now reach boxes it was checked against already */
+            j = i;
+        }
+    }
+
+    return merged;
+}
+
+/* Finds the blobs of area, as labelling all of it would */
+static void redeye_search(redeye_search_t *search, const redeye_tap_t *area) {
+    guint64 whole = (guint64) (area->maxX - area->minX) * (area->maxY - area->minY), covered = 0;
+    guint64 start = search->thresholded;
+    int run, i;
+
+    search->n_blobs = 0;
+    search->n_boxes = 0;
+    if (search->options->proxy > 1) {
+        redeye_search_cells(search, area);
+        label_components(&search->runs, search->blocks, search->blocks_width, search->blocks_height);
+
+        if (search->runs.len - MIN_ID > search->boxes_size) {
+            search->boxes_size = search->runs.len - MIN_ID;
+            search->boxes = g_renew(redeye_tap_t, search->boxes, search->boxes_size);
+        }
+        for (run = MIN_ID; run < search->runs.len; run++) {
+            redeye_tap_t *bounds = &search->boxes[search->n_boxes++];
+
+            redeye_run_bounds(search, area, run, bounds);
+            covered += (guint64) (bounds->maxX - bounds->minX) * (bounds->maxY - bounds->minY);
+        }
+    }
+
+    /*
+     * Unless the runs take in half the area, label around them. Blobs are
+     * gathered again whenever boxes merge, as the merged box may hold them
+     * twice. Once that has cost half of labelling the whole area, red is
+     * spread too widely to gain anything, and the whole area is labelled.
+     */
+    if (search->options->proxy > 1 && covered < whole / 2) {
+        gboolean merged;
+
+        do {
+            search->n_blobs = 0;
+            for (i = 0; i < search->n_boxes && search->thresholded - start < whole / 2; i++) {
+                do {
+                    redeye_search_label(search, &search->boxes[i]);
+                } while (redeye_box_grow(search, area, &search->boxes[i]));
+                redeye_search_add(search);
             }
+            merged = redeye_boxes_merge(search);
+        } while (merged && search->thresholded - start < whole / 2);
 
-            pixel += pixWidth;
+        if (i == search->n_boxes && !merged) {
+            if (search->n_blobs > 1)
+                qsort(search->blobs, search->n_blobs, sizeof(redeye_blob_t), redeye_blob_compare);
+            return;
         }
+        search->n_blobs = 0;
     }
 
+    redeye_search_label(search, area);
+    redeye_search_add(search);
 }
 
-static void preview_blob(redeyeop_t *op, int blob_id, int colour, gboolean reset_preview) {
-    int y, x;
-    int minX, minY, maxX, maxY;
-    int hr, hg, hb;
+/* The blob for a tap, of those found by the last search, or -1 if there is none */
+static int redeye_choose_blob(const redeye_search_t *search, const redeye_tap_t *tap, const int *taken,
+                              int n_taken) {
+    int blob, i;
 
-    redeye_preview(op, reset_preview);
+    for (blob = search->n_blobs - 1; blob >= 0; blob--) {
+        const region_info *r = &search->blobs[blob].r;
 
-    hr = (colour >> 16) & 0xff;
-    hg = (colour >> 8) & 0xff;
-    hb = (colour) & 0xff;
+        if (r->minX < tap->minX || r->maxX >= tap->maxX || r->minY < tap->minY || r->maxY >= tap->maxY)
+            continue;
+        if (!redeye_eyelike(r, search->options))
+            continue;
 
-    minY = 0;
-    maxY = gdk_pixbuf_get_height(op->preview) - 1;
-    minX = 0;
-    maxX = gdk_pixbuf_get_width(op->preview) - 1;
+        for (i = 0; i < n_taken && taken[i] != blob; i++);
+        if (i == n_taken)
+            return blob;
+    }
 
-    guchar *data = gdk_pixbuf_get_pixels(op->preview);
-    int rowstride = gdk_pixbuf_get_rowstride(op->preview);
-    int pixWidth = gdk_pixbuf_get_has_alpha(op->preview) ? 4 : 3;
+    return -1;
+}
+
+/* Whether a blob found by the last search lies partly in the tap's area and partly outside it */
+static gboolean redeye_tap_cut(const redeye_search_t *search, const redeye_tap_t *tap) {
+    int blob;
+
+    for (blob = 0; blob < search->n_blobs; blob++) {
+        const region_info *r = &search->blobs[blob].r;
+
+        if (r->maxX < tap->minX || r->minX >= tap->maxX || r->maxY < tap->minY || r->minY >= tap->maxY)
+            continue;
+        if (r->minX < tap->minX || r->maxX >= tap->maxX || r->minY < tap->minY || r->maxY >= tap->maxY)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* A copy of the pixels a correction changes, to check it against or undo it with; NULL if it changes none */
+static guchar *desaturation_save(const desaturation_t *fix, GdkPixbuf *pixbuf) {
+    guchar *data = gdk_pixbuf_get_pixels(pixbuf), *saved;
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int pixWidth = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
+    int minX, minY, maxX, maxY, y, row;
+
+    if (!desaturation_bounds(fix, &minX, &minY, &maxX, &maxY))
+        return NULL;
+
+    row = (maxX - minX + 1) * pixWidth;
+    saved = g_new(guchar, row * (maxY - minY + 1));
+    for (y = minY; y <= maxY; y++)
+        memcpy(saved + ((y - minY) * row), data + (rowstride * y) + (minX * pixWidth), row);
+
+    return saved;
+}
+
+static void desaturation_restore(const desaturation_t *fix, GdkPixbuf *pixbuf, const guchar *saved) {
+    guchar *data = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int pixWidth = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
+    int minX, minY, maxX, maxY, y, row;
+
+    if (saved == NULL || !desaturation_bounds(fix, &minX, &minY, &maxX, &maxY))
+        return;
+
+    row = (maxX - minX + 1) * pixWidth;
+    for (y = minY; y <= maxY; y++)
+        memcpy(data + (rowstride * y) + (minX * pixWidth), saved + ((y - minY) * row), row);
+}
+
+/*
+ * Whether an applied correction only took the red out of its own blob: its
+ * pixels are no longer red, and every pixel around them in the feather is
+ * red only if it was before.
+ */
+static gboolean desaturation_contained(const desaturation_t *fix, GdkPixbuf *pixbuf, const guchar *saved,
+                                       const redeye_threshold_t *threshold) {
+    const feather_map_t *map = &fix->map;
+    guchar *data = gdk_pixbuf_get_pixels(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int pixWidth = gdk_pixbuf_get_has_alpha(pixbuf) ? 4 : 3;
+    int minX, minY, maxX, maxY, x, y;
+
+    if (saved == NULL || !desaturation_bounds(fix, &minX, &minY, &maxX, &maxY))
+        return TRUE;
 
     for (y = minY; y <= maxY; y++) {
-        guchar *thisLine = data + (rowstride * y);
-        guchar *pixel;
+        const guchar *alpha = map->alpha + ((y - map->y0) * map->width) - map->x0;
+        const guchar *before = saved + ((y - minY) * (maxX - minX + 1) * pixWidth);
+        const guchar *after = data + (rowstride * y) + (minX * pixWidth);
 
-        pixel = thisLine + (minX * pixWidth);
+        for (x = minX; x <= maxX; x++, before += pixWidth, after += pixWidth) {
+            gboolean red = redeye_threshold_met(threshold, before) && alpha[x] < FEATHER_FULL;
 
-        for (x = minX; x <= maxX; x++) {
+            if (redeye_threshold_met(threshold, after) != red)
+                return FALSE;
+        }
+    }
 
-            double alpha = alpha_level_for_pixel(op, x + op->area.minX, y + op->area.minY, blob_id);
-            int r, g, b;
+    return TRUE;
+}
 
-            r = (pixel[0]);
-            g = (pixel[1]);
-            b = (pixel[2]);
+/*
+ * Corrects the chosen blobs of the last search, working out every correction
+ * before making any. Taps after the first expect to find what the search
+ * found less the blobs already corrected, which holds as long as each
+ * correction leaves the red of the pixels around its blob alone. When
+ * checked, a correction that does change it (its feather reaching into a
+ * nearby blob, say) has everything put back, and FALSE is returned.
+ */
+static gboolean redeye_correct_chosen(redeye_search_t *search, const int *chosen, int n_chosen, gboolean check) {
+    desaturation_t *fixes = g_new0(desaturation_t, n_chosen);
+    guchar **saved = g_new0(guchar *, n_chosen);
+    redeye_threshold_t threshold;
+    gboolean contained = TRUE;
+    int i, n_applied;
+
+    /*
+     * Nothing is corrected until all are worked out, so labelling the same
+     * area again gives the same labels; each area is labelled once at most,
+     * for all the chosen blobs in it.
+     */
+    for (i = 0; i < n_chosen; i++) {
+        const redeye_blob_t *blob = &search->blobs[chosen[i]];
+        const redeyeop_t *op = &search->op;
+        int j;
+
+        if (fixes[i].map.alpha != NULL)
+            continue;
+        if (op->area.minX != blob->area.minX || op->area.minY != blob->area.minY ||
+            op->area.maxX != blob->area.maxX || op->area.maxY != blob->area.maxY)
+            redeye_search_label(search, &blob->area);
+
+        for (j = i; j < n_chosen; j++) {
+            const redeye_blob_t *other = &search->blobs[chosen[j]];
+
+            if (other->area.minX == blob->area.minX && other->area.minY == blob->area.minY &&
+                other->area.maxX == blob->area.maxX && other->area.maxY == blob->area.maxY)
+                desaturation_init(&fixes[j], &search->op, other->id);
+        }
+    }
 
-            if (alpha > 0) {
+    redeye_threshold_init(&threshold, search->options->green_sensitivity, search->options->blue_sensitivity,
+                          search->options->min_red_val);
+    for (n_applied = 0; n_applied < n_chosen && contained; n_applied++) {
+        if (check)
+            saved[n_applied] = desaturation_save(&fixes[n_applied], search->op.pixbuf);
+        desaturation_apply(&fixes[n_applied], search->op.pixbuf);
+        if (check)
+            contained = desaturation_contained(&fixes[n_applied], search->op.pixbuf, saved[n_applied], &threshold);
+    }
 
-                pixel[0] = col((1 - alpha) * r + (alpha * hr));
-                pixel[1] = col((1 - alpha) * g + (alpha * hg));
-                pixel[2] = col((1 - alpha) * b + (alpha * hb));
-            }
+    /* Undone last first, as their pixels overlap */
+    for (i = n_applied - 1; !contained && i >= 0; i--)
+        desaturation_restore(&fixes[i], search->op.pixbuf, saved[i]);
 
-            pixel += pixWidth;
+    for (i = 0; i < n_chosen; i++) {
+        g_free(fixes[i].map.alpha);
+        g_free(saved[i]);
+    }
+    g_free(fixes);
+    g_free(saved);
+
+    return contained;
+}
+
+/* Scans each of the group's taps on its own, correcting as it goes */
+static void redeye_correct_each(redeye_search_t *search, const redeye_taps_args_t *args, int group) {
+    int i, blob;
+
+    for (i = 0; i < args->n_taps; i++) {
+        if (args->taps[i].group != group)
+            continue;
+        redeye_search(search, &args->taps[i]);
+        if ((blob = redeye_choose_blob(search, &args->taps[i], NULL, 0)) >= 0)
+            redeye_correct_chosen(search, &blob, 1, FALSE);
+    }
+}
+
+static void *correct_taps_without_gvl(void *data) {
+    redeye_taps_args_t *args = data;
+    redeye_tap_t *groups = g_new(redeye_tap_t, args->n_taps);
+    int *taken = g_new(int, args->n_taps);
+    redeye_search_t search;
+    int n_groups, group, i;
+
+    memset(&search, 0, sizeof(search));
+    search.op.pixbuf = args->pixbuf;
+    search.options = &args->options;
+    n_groups = redeye_group_taps(args->taps, args->n_taps, groups);
+
+    for (group = 0; group < n_groups; group++) {
+        int n_taken = 0, n_group_taps = 0;
+
+        redeye_search(&search, &groups[group]);
+
+        for (i = 0; i < args->n_taps; i++) {
+            if (args->taps[i].group == group && redeye_tap_cut(&search, &args->taps[i]))
+                break;
         }
+        if (i < args->n_taps) {
+            redeye_correct_each(&search, args, group);
+            continue;
+        }
+
+        for (i = 0; i < args->n_taps; i++) {
+            int blob;
+
+            if (args->taps[i].group != group)
+                continue;
+            n_group_taps++;
+            blob = redeye_choose_blob(&search, &args->taps[i], taken, n_taken);
+            if (blob >= 0)
+                taken[n_taken++] = blob;
+        }
+
+        /* A lone tap has no later scan to upset */
+        if (!redeye_correct_chosen(&search, taken, n_taken, n_group_taps > 1))
+            redeye_correct_each(&search, args, group);
     }
 
+    g_free(search.op.mask);
+    label_regions_free(&search.op.regions);
+    g_free(search.blobs);
+    g_free(search.blocks);
+    label_regions_free(&search.runs);
+    g_free(search.boxes);
+    g_free(groups);
+    g_free(taken);
+
+    g_mutex_lock(&redeye_search_stats.lock);
+    redeye_search_stats.sampled += search.sampled;
+    redeye_search_stats.thresholded += search.thresholded;
+    g_mutex_unlock(&redeye_search_stats.lock);
+
+    return NULL;
+}
+
+/*
+ * The eye-like blobs nearest a point, for RedEye#find_blobs, ranked by the
+ * distance from the point to the centre of each blob's bounds. Ties go to
+ * the blob later in scan order, as that is the one a tap would take.
+ */
+typedef struct {
+    int blob;
+    double distance;
+} redeye_candidate_t;
+
+typedef struct {
+    redeyeop_t *op;
+    redeye_options_t options;
+    double x, y;
+    /* Up to limit blobs, nearest first */
+    int *blobs, n_blobs, limit;
+} redeye_find_args_t;
+
+static int redeye_candidate_compare(const void *a, const void *b) {
+    const redeye_candidate_t *ca = a, *cb = b;
+
+    if (ca->distance != cb->distance)
+        return (ca->distance < cb->distance) ? -1 : 1;
+    return cb->blob - ca->blob;
+}
+
+static void *find_blobs_without_gvl(void *data) {
+    redeye_find_args_t *args = data;
+    redeyeop_t *op = args->op;
+    const redeye_options_t *options = &args->options;
+    redeye_candidate_t *candidates;
+    int n = 0, blob, i;
+
+    if (op->mask == NULL)
+        op->mask = g_new(guchar, op->area.width * op->area.height);
+    redeye_identify(op, options->green_sensitivity, options->blue_sensitivity, options->min_red_val);
+
+    candidates = g_new(redeye_candidate_t, op->regions.len);
+    for (blob = MIN_ID; blob < op->regions.len; blob++) {
+        const region_info *r = &op->regions.region[blob];
+        double dx, dy;
+
+        if (!redeye_eyelike(r, options))
+            continue;
+
+        dx = op->area.minX + (r->minX + r->maxX) / 2.0 - args->x;
+        dy = op->area.minY + (r->minY + r->maxY) / 2.0 - args->y;
+        candidates[n].blob = blob;
+        candidates[n].distance = (dx * dx) + (dy * dy);
+        n++;
+    }
+
+    qsort(candidates, n, sizeof(redeye_candidate_t), redeye_candidate_compare);
+
+    args->n_blobs = MIN(n, args->limit);
+    for (i = 0; i < args->n_blobs; i++)
+        args->blobs[i] = candidates[i].blob;
+    g_free(candidates);
+
+    return NULL;
 }
 
 /* Code */
@@ -560,16 +1398,18 @@ PixbufUtils_CLASS_contrast(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR
     GdkPixbuf *__orig_src;
     int adjust;
     int __orig_adjust;
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
+    __orig_src = src = pixbuf_arg(__v_src);
     __orig_adjust = adjust = NUM2INT(__v_adjust);
 
     IGNORE(self);
     do {
-        __p_retval = unref_pixbuf((pixbuf_adjust_contrast(src, gdk_pixbuf_copy(src), adjust)));
+        pixbuf_op_args_t args = {.src = src, .adjust = adjust};
+        __p_retval = unref_pixbuf(without_gvl(contrast_without_gvl, &args));
         goto out;
     }
     while (0);
     out:;
+    RB_GC_GUARD(__v_src);
     return __p_retval;
 }
 
@@ -580,40 +1420,71 @@ PixbufUtils_CLASS_brightness(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_AT
     GdkPixbuf *__orig_src;
     int adjust;
     int __orig_adjust;
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
+    __orig_src = src = pixbuf_arg(__v_src);
     __orig_adjust = adjust = NUM2INT(__v_adjust);
 
     IGNORE(self);
     do {
-        __p_retval = unref_pixbuf((pixbuf_adjust_brightness(src, gdk_pixbuf_copy(src), adjust)));
+        pixbuf_op_args_t args = {.src = src, .adjust = adjust};
+        __p_retval = unref_pixbuf(without_gvl(brightness_without_gvl, &args));
         goto out;
     }
     while (0);
     out:;
+    RB_GC_GUARD(__v_src);
     return __p_retval;
 }
 
+/* The side of a square convolution matrix with matrix_size entries, which must have a centre tap */
+static int matrix_side(long matrix_size) {
+    int len = (int) sqrt((double) matrix_size);
+
+    if ((len * len) != matrix_size) {
+        rb_raise(rb_eArgError, "Invalid matrix size - sqrt(%li)*sqrt(%li) != %li", matrix_size, matrix_size,
+                 matrix_size);
+    }
+    if ((len & 1) == 0) {
+        rb_raise(rb_eArgError, "Invalid matrix size - %ix%i has no centre", len, len);
+    }
+
+    return len;
+}
+
 static VALUE
-PixbufUtils_CLASS_filter(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE filter OPTIONAL_ATTR,
-                         VALUE __v_divisor OPTIONAL_ATTR) {
+PixbufUtils_CLASS_filter(int __p_argc, VALUE *__p_argv, VALUE self) {
     VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    VALUE __v_src = Qnil;
     GdkPixbuf *src;
     GdkPixbuf *__orig_src;
+    VALUE filter = Qnil;
+    VALUE __v_divisor = Qnil;
     double divisor;
     double __orig_divisor;
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
+    VALUE __v_iterations = Qnil;
+    int iterations;
+    int __orig_iterations;
+
+    /* Scan arguments */
+    rb_scan_args(__p_argc, __p_argv, "31", &__v_src, &filter, &__v_divisor, &__v_iterations);
+
+    /* Set defaults */
+    __orig_src = src = pixbuf_arg(__v_src);
     Check_Type(filter, T_ARRAY);
     __orig_divisor = divisor = NUM2DBL(__v_divisor);
 
+    if (__p_argc > 3)
+        __orig_iterations = iterations = NUM2INT(__v_iterations);
+    else
+        iterations = 1;
+
     do {
         long matrix_size = RARRAY_LEN(filter), i;
         int len;
         double *matrix;
         IGNORE(self);
-        len = (int) sqrt((double) matrix_size);
-        if ((len * len) != matrix_size) {
-            rb_raise(rb_eArgError, "Invalid matrix size - sqrt(%li)*sqrt(%li) != %li", matrix_size, matrix_size,
-                     matrix_size);
+        len = matrix_side(matrix_size);
+        if (iterations < 1) {
+            rb_raise(rb_eArgError, "Invalid number of iterations - %i", iterations);
         }
         matrix = ALLOCA_N(
         double, matrix_size);
@@ -623,39 +1494,197 @@ PixbufUtils_CLASS_filter(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR,
             matrix[i] = NUM2DBL(RARRAY_PTR(filter)[i]);
         }
         do {
-            __p_retval = unref_pixbuf((pixbuf_convolution_matrix(src, gdk_pixbuf_copy(src), len, matrix, divisor)));
+            pixbuf_op_args_t args = {.src = src, .matrix = matrix, .matrix_size = len, .divisor = divisor,
+                                     .iterations = iterations};
+            __p_retval = unref_pixbuf(without_gvl(filter_without_gvl, &args));
             goto out;
         }
         while (0);
 
-    } while (0);
+    } while (0);
+
+    out:;
+    RB_GC_GUARD(__v_src);
+    return __p_retval;
+}
+
+static VALUE
+PixbufUtils_CLASS_rotate(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_angle OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    GdkPixbuf *src;
+    GdkPixbuf *__orig_src;
+    int angle;
+    int __orig_angle;
+    __orig_src = src = pixbuf_arg(__v_src);
+    __orig_angle = angle = NUM2INT(__v_angle);
+
+    IGNORE(self);
+    if (angle != 0 && angle != 90 && angle != 180 && angle != 270) {
+        rb_raise(rb_eArgError, "Invalid angle - %i is not a multiple of 90 between 0 and 270", angle);
+    }
+    do {
+        pixbuf_op_args_t args = {.src = src, .angle = angle};
+        __p_retval = unref_pixbuf(without_gvl(rotate_without_gvl, &args));
+        goto out;
+    }
+    while (0);
+    out:;
+    RB_GC_GUARD(__v_src);
+    return __p_retval;
+}
+
+static VALUE
+PixbufUtils_CLASS_straighten(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_angle OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    GdkPixbuf *src;
+    GdkPixbuf *__orig_src;
+    double angle;
+    double __orig_angle;
+    __orig_src = src = pixbuf_arg(__v_src);
+    __orig_angle = angle = NUM2DBL(__v_angle);
+
+    IGNORE(self);
+    do {
+        pixbuf_op_args_t args = {.src = src, .degrees = angle};
+        __p_retval = unref_pixbuf(without_gvl(straighten_without_gvl, &args));
+        goto out;
+    }
+    while (0);
+    out:;
+    RB_GC_GUARD(__v_src);
+    return __p_retval;
+}
+
+
+static VALUE
+PixbufUtils_CLASS_crop_fill(int __p_argc, VALUE *__p_argv, VALUE self) {
+    VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    VALUE __v_src = Qnil;
+    GdkPixbuf *src;
+    GdkPixbuf *__orig_src;
+    VALUE __v_x = Qnil;
+    int x;
+    int __orig_x;
+    VALUE __v_y = Qnil;
+    int y;
+    int __orig_y;
+    VALUE __v_width = Qnil;
+    int width;
+    int __orig_width;
+    VALUE __v_height = Qnil;
+    int height;
+    int __orig_height;
+    VALUE __v_fill = Qnil;
+    guint32 fill;
+    guint32 __orig_fill;
+
+    /* Scan arguments */
+    rb_scan_args(__p_argc, __p_argv, "51", &__v_src, &__v_x, &__v_y, &__v_width, &__v_height, &__v_fill);
+
+    /* Set defaults */
+    __orig_src = src = pixbuf_arg(__v_src);
+
+    __orig_x = x = NUM2INT(__v_x);
+
+    __orig_y = y = NUM2INT(__v_y);
+
+    __orig_width = width = NUM2INT(__v_width);
+
+    __orig_height = height = NUM2INT(__v_height);
+
+    if (__p_argc > 5)
+        __orig_fill = fill = NUM2UINT(__v_fill);
+    else
+        fill = 0xffffffff;
 
+    IGNORE(self);
+    if (width < 1 || height < 1) {
+        rb_raise(rb_eArgError, "Invalid crop size - %ix%i", width, height);
+    }
+    do {
+        pixbuf_op_args_t args = {.src = src, .x = x, .y = y, .width = width, .height = height, .fill = fill};
+        __p_retval = unref_pixbuf(without_gvl(crop_fill_without_gvl, &args));
+        goto out;
+    }
+    while (0);
     out:;
+    RB_GC_GUARD(__v_src);
     return __p_retval;
 }
 
+/* Reads an array of exactly n numbers into values */
+static void array_to_doubles(VALUE ary, double *values, long n, const char *what) {
+    long i;
+
+    Check_Type(ary, T_ARRAY);
+    if (RARRAY_LEN(ary) != n) {
+        rb_raise(rb_eArgError, "Invalid %s - expected %li numbers, got %li", what, n, RARRAY_LEN(ary));
+    }
+    for (i = 0; i < n; i++) {
+        values[i] = NUM2DBL(RARRAY_AREF(ary, i));
+    }
+}
+
+/* Reads border arguments as taken by PixbufUtils.border into spec */
+static void border_spec_from_ruby(border_spec_t *spec, VALUE __v_colour, VALUE __v_frame, VALUE __v_clip,
+                                  VALUE __v_radius, VALUE __v_origin, VALUE __v_scale) {
+    guint32 colour;
+    double radius, scale;
+    double frame[4], clip[4], origin[2];
+
+    colour = NUM2UINT(__v_colour);
+    array_to_doubles(__v_frame, frame, 4, "frame - [x, y, width, height]");
+    array_to_doubles(__v_clip, clip, 4, "clip - [x, y, width, height]");
+    radius = NUM2DBL(__v_radius);
+    array_to_doubles(__v_origin, origin, 2, "origin - [x, y]");
+    scale = NUM2DBL(__v_scale);
+
+    if (!(scale > 0)) {
+        rb_raise(rb_eArgError, "Invalid scale - %f", scale);
+    }
+
+    spec->colour[0] = (colour >> 24) & 0xff;
+    spec->colour[1] = (colour >> 16) & 0xff;
+    spec->colour[2] = (colour >> 8) & 0xff;
+    spec->frame_x0 = (int) floor(frame[0]);
+    spec->frame_y0 = (int) floor(frame[1]);
+    spec->frame_x1 = (int) floor(frame[0] + frame[2]);
+    spec->frame_y1 = (int) floor(frame[1] + frame[3]);
+    spec->clip_x0 = clip[0];
+    spec->clip_y0 = clip[1];
+    spec->clip_x1 = clip[0] + clip[2];
+    spec->clip_y1 = clip[1] + clip[3];
+    /* Corner radii are limited to half the clip, as in CairoExt.rounded_rectangle */
+    spec->radius_x = MAX(MIN(radius, clip[2] / 2), 0);
+    spec->radius_y = MAX(MIN(radius, clip[3] / 2), 0);
+    spec->origin_x = origin[0];
+    spec->origin_y = origin[1];
+    spec->scale = scale;
+}
+
 static VALUE
-PixbufUtils_CLASS_rotate(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_angle OPTIONAL_ATTR) {
+PixbufUtils_CLASS_border(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_colour OPTIONAL_ATTR,
+                         VALUE __v_frame OPTIONAL_ATTR, VALUE __v_clip OPTIONAL_ATTR, VALUE __v_radius OPTIONAL_ATTR,
+                         VALUE __v_origin OPTIONAL_ATTR, VALUE __v_scale OPTIONAL_ATTR) {
     VALUE __p_retval OPTIONAL_ATTR = Qnil;
     GdkPixbuf *src;
     GdkPixbuf *__orig_src;
-    int angle;
-    int __orig_angle;
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
-    __orig_angle = angle = NUM2INT(__v_angle);
+    border_spec_t spec;
+    __orig_src = src = pixbuf_arg(__v_src);
+    border_spec_from_ruby(&spec, __v_colour, __v_frame, __v_clip, __v_radius, __v_origin, __v_scale);
 
     IGNORE(self);
-    g_assert(angle == 0 || angle == 90 || angle == 180 || angle == 270);
     do {
-        __p_retval = unref_pixbuf((pixbuf_rotate(src, (rotate_angle_t) angle)));
+        pixbuf_op_args_t args = {.src = src, .border = &spec};
+        __p_retval = unref_pixbuf(without_gvl(border_without_gvl, &args));
         goto out;
     }
     while (0);
     out:;
+    RB_GC_GUARD(__v_src);
     return __p_retval;
 }
 
-
 static VALUE
 PixbufUtils_CLASS_gamma(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_level OPTIONAL_ATTR) {
     VALUE __p_retval OPTIONAL_ATTR = Qnil;
@@ -663,16 +1692,18 @@ PixbufUtils_CLASS_gamma(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, V
     GdkPixbuf *__orig_src;
     double level;
     double __orig_level;
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
+    __orig_src = src = pixbuf_arg(__v_src);
     __orig_level = level = NUM2DBL(__v_level);
 
     IGNORE(self);
     do {
-        __p_retval = unref_pixbuf((pixbuf_gamma(src, gdk_pixbuf_copy(src), level)));
+        pixbuf_op_args_t args = {.src = src, .level = level};
+        __p_retval = unref_pixbuf(without_gvl(gamma_without_gvl, &args));
         goto out;
     }
     while (0);
     out:;
+    RB_GC_GUARD(__v_src);
     return __p_retval;
 }
 
@@ -699,7 +1730,7 @@ PixbufUtils_CLASS_tint(int __p_argc, VALUE *__p_argv, VALUE self) {
     rb_scan_args(__p_argc, __p_argv, "41", &__v_src, &__v_r, &__v_g, &__v_b, &__v_alpha);
 
     /* Set defaults */
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
+    __orig_src = src = pixbuf_arg(__v_src);
 
     __orig_r = r = NUM2INT(__v_r);
 
@@ -714,11 +1745,13 @@ PixbufUtils_CLASS_tint(int __p_argc, VALUE *__p_argv, VALUE self) {
 
     IGNORE(self);
     do {
-        __p_retval = unref_pixbuf((pixbuf_tint(src, gdk_pixbuf_copy(src), r, g, b, alpha)));
+        pixbuf_op_args_t args = {.src = src, .r = r, .g = g, .b = b, .alpha = alpha};
+        __p_retval = unref_pixbuf(without_gvl(tint_without_gvl, &args));
         goto out;
     }
     while (0);
     out:;
+    RB_GC_GUARD(__v_src);
     return __p_retval;
 }
 
@@ -729,19 +1762,440 @@ PixbufUtils_CLASS_mask(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VA
     GdkPixbuf *__orig_src;
     GdkPixbuf *mask;
     GdkPixbuf *__orig_mask;
-    __orig_src = src = GDK_PIXBUF(RVAL2GOBJ(__v_src));
-    __orig_mask = mask = GDK_PIXBUF(RVAL2GOBJ(__v_mask));
+    __orig_src = src = pixbuf_arg(__v_src);
+    __orig_mask = mask = pixbuf_arg(__v_mask);
+
+    IGNORE(self);
+    if (gdk_pixbuf_get_width(mask) > gdk_pixbuf_get_width(src) ||
+        gdk_pixbuf_get_height(mask) > gdk_pixbuf_get_height(src)) {
+        rb_raise(rb_eArgError, "Mask is bigger than the image");
+    }
+    do {
+        pixbuf_op_args_t args = {.src = src, .mask = mask};
+        __p_retval = unref_pixbuf(without_gvl(mask_without_gvl, &args));
+        goto out;
+    }
+    while (0);
+    out:;
+    RB_GC_GUARD(__v_src);
+    RB_GC_GUARD(__v_mask);
+    return __p_retval;
+}
+
+static VALUE
+PixbufUtils_CLASS_colour_lut(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_brightness OPTIONAL_ATTR,
+                             VALUE __v_gamma OPTIONAL_ATTR, VALUE __v_contrast OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    GdkPixbuf *src;
+    GdkPixbuf *__orig_src;
+    int brightness;
+    int __orig_brightness;
+    gboolean apply_gamma;
+    double gamma;
+    int contrast;
+    int __orig_contrast;
+    __orig_src = src = pixbuf_arg(__v_src);
+    __orig_brightness = brightness = NUM2INT(__v_brightness);
+    /* nil skips gamma - unlike brightness and contrast, a gamma of 1.0 is not an exact identity */
+    apply_gamma = !NIL_P(__v_gamma);
+    gamma = apply_gamma ? NUM2DBL(__v_gamma) : 1.0;
+    __orig_contrast = contrast = NUM2INT(__v_contrast);
 
     IGNORE(self);
     do {
-        __p_retval = unref_pixbuf((pixbuf_mask(src, mask)));
+        pixbuf_op_args_t args = {.src = src, .adjust = brightness, .apply_level = apply_gamma, .level = gamma,
+                                 .contrast = contrast};
+        __p_retval = unref_pixbuf(without_gvl(colour_lut_without_gvl, &args));
         goto out;
     }
     while (0);
     out:;
+    RB_GC_GUARD(__v_src);
+    return __p_retval;
+}
+
+/* In-place variants - these modify and return src */
+
+static VALUE
+PixbufUtils_CLASS_contrast_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_adjust OPTIONAL_ATTR) {
+    GdkPixbuf *src = pixbuf_arg(__v_src);
+    pixbuf_op_args_t args = {.src = src, .in_place = TRUE, .adjust = NUM2INT(__v_adjust)};
+
+    IGNORE(self);
+    without_gvl(contrast_without_gvl, &args);
+    return __v_src;
+}
+
+static VALUE
+PixbufUtils_CLASS_brightness_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_adjust OPTIONAL_ATTR) {
+    GdkPixbuf *src = pixbuf_arg(__v_src);
+    pixbuf_op_args_t args = {.src = src, .in_place = TRUE, .adjust = NUM2INT(__v_adjust)};
+
+    IGNORE(self);
+    without_gvl(brightness_without_gvl, &args);
+    return __v_src;
+}
+
+static VALUE
+PixbufUtils_CLASS_gamma_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_level OPTIONAL_ATTR) {
+    GdkPixbuf *src = pixbuf_arg(__v_src);
+    pixbuf_op_args_t args = {.src = src, .in_place = TRUE, .level = NUM2DBL(__v_level)};
+
+    IGNORE(self);
+    without_gvl(gamma_without_gvl, &args);
+    return __v_src;
+}
+
+/* Returns src, converted in place, or nil if the profile was sRGB already or could not be used */
+static VALUE
+PixbufUtils_CLASS_icc_to_srgb_bang(int __p_argc, VALUE *__p_argv, VALUE self) {
+    VALUE __v_src = Qnil, __v_profile = Qnil, __v_intent = Qnil;
+    pixbuf_op_args_t args = {.in_place = TRUE};
+    VALUE __p_retval = Qnil;
+    gchar *profile;
+
+    rb_scan_args(__p_argc, __p_argv, "21", &__v_src, &__v_profile, &__v_intent);
+
+    IGNORE(self);
+    args.src = pixbuf_arg(__v_src);
+    /* Perceptual, relative colorimetric, saturation or absolute colorimetric, as numbered by ICC */
+    args.intent = NIL_P(__v_intent) ? INTENT_PERCEPTUAL : NUM2INT(__v_intent);
+    if (args.intent < 0 || args.intent > 3) {
+        rb_raise(rb_eArgError, "Invalid rendering intent - %i", args.intent);
+    }
+    StringValue(__v_profile);
+    /* Copied, as other threads may change or free the string once the GVL is released */
+    args.profile_length = RSTRING_LEN(__v_profile);
+    profile = g_malloc(MAX(args.profile_length, 1));
+    memcpy(profile, RSTRING_PTR(__v_profile), args.profile_length);
+    args.profile = profile;
+
+    if (without_gvl(icc_to_srgb_without_gvl, &args))
+        __p_retval = __v_src;
+
+    g_free(profile);
+    return __p_retval;
+}
+
+/* The [x, y, width, height] part of a JPEG file, decoded alone, or nil if it cannot be (see jpeg.h) */
+static VALUE
+PixbufUtils_CLASS_load_jpeg_region(VALUE self OPTIONAL_ATTR, VALUE __v_path OPTIONAL_ATTR, VALUE __v_x OPTIONAL_ATTR,
+                                   VALUE __v_y OPTIONAL_ATTR, VALUE __v_width OPTIONAL_ATTR,
+                                   VALUE __v_height OPTIONAL_ATTR) {
+    pixbuf_op_args_t args = {.x = NUM2INT(__v_x), .y = NUM2INT(__v_y), .width = NUM2INT(__v_width),
+                             .height = NUM2INT(__v_height)};
+    GdkPixbuf *pixbuf;
+    gchar *path;
+    VALUE __p_retval = Qnil;
+
+    IGNORE(self);
+    /* Copied, as other threads may change or free the string once the GVL is released */
+    path = g_strdup(StringValueCStr(__v_path));
+    args.path = path;
+
+    pixbuf = without_gvl(load_jpeg_region_without_gvl, &args);
+    g_free(path);
+    if (pixbuf != NULL)
+        __p_retval = unref_pixbuf(pixbuf);
+
+    return __p_retval;
+}
+
+static VALUE
+PixbufUtils_CLASS_tint_bang(int __p_argc, VALUE *__p_argv, VALUE self) {
+    VALUE __v_src = Qnil, __v_r = Qnil, __v_g = Qnil, __v_b = Qnil, __v_alpha = Qnil;
+    pixbuf_op_args_t args = {.in_place = TRUE};
+
+    rb_scan_args(__p_argc, __p_argv, "41", &__v_src, &__v_r, &__v_g, &__v_b, &__v_alpha);
+
+    args.src = pixbuf_arg(__v_src);
+    args.r = NUM2INT(__v_r);
+    args.g = NUM2INT(__v_g);
+    args.b = NUM2INT(__v_b);
+    args.alpha = (__p_argc > 4) ? NUM2INT(__v_alpha) : 255;
+
+    IGNORE(self);
+    without_gvl(tint_without_gvl, &args);
+    return __v_src;
+}
+
+static VALUE
+PixbufUtils_CLASS_colour_lut_bang(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR,
+                                  VALUE __v_brightness OPTIONAL_ATTR, VALUE __v_gamma OPTIONAL_ATTR,
+                                  VALUE __v_contrast OPTIONAL_ATTR) {
+    GdkPixbuf *src = pixbuf_arg(__v_src);
+    pixbuf_op_args_t args = {.src = src, .in_place = TRUE, .adjust = NUM2INT(__v_brightness),
+                             .apply_level = !NIL_P(__v_gamma), .contrast = NUM2INT(__v_contrast)};
+
+    args.level = args.apply_level ? NUM2DBL(__v_gamma) : 1.0;
+
+    IGNORE(self);
+    without_gvl(colour_lut_without_gvl, &args);
+    return __v_src;
+}
+
+/* The arguments of a [name, *args] pipeline stage, checking there are n of them */
+static const VALUE *pipeline_stage_args(VALUE stage, long n) {
+    if (RARRAY_LEN(stage) != n + 1) {
+        VALUE name = rb_inspect(RARRAY_AREF(stage, 0));
+        rb_raise(rb_eArgError, "Invalid pipeline stage %s - expected %li arguments, got %li", StringValueCStr(name), n,
+                 RARRAY_LEN(stage) - 1);
+    }
+    return RARRAY_CONST_PTR(stage) + 1;
+}
+
+/*
+ * Reads a stage as planned by MorandiNative::Pipeline, copying any matrix
+ * into matrices, which has room for `room` more values. Returns how many
+ * values it used.
+ */
+static long pipeline_stage_from_ruby(pipeline_stage_t *stage, VALUE ary, double *matrices, long room) {
+    const VALUE *args;
+    ID name;
+
+    Check_Type(ary, T_ARRAY);
+    if (RARRAY_LEN(ary) < 1 || !SYMBOL_P(RARRAY_AREF(ary, 0))) {
+        rb_raise(rb_eArgError, "Invalid pipeline stage - expected [name, *args]");
+    }
+    name = SYM2ID(RARRAY_AREF(ary, 0));
+
+    if (name == rb_intern("colour_lut")) {
+        args = pipeline_stage_args(ary, 3);
+        stage->kind = PIPELINE_COLOUR_LUT;
+        stage->map_alpha = !NIL_P(args[1]);
+        colour_lut(stage->map, stage->alpha_map, NUM2INT(args[0]), stage->map_alpha,
+                   stage->map_alpha ? NUM2DBL(args[1]) : 1.0, NUM2INT(args[2]));
+    } else if (name == rb_intern("tint")) {
+        args = pipeline_stage_args(ary, 4);
+        stage->kind = PIPELINE_TINT;
+        tint_tables(&stage->tint, NUM2INT(args[0]), NUM2INT(args[1]), NUM2INT(args[2]), NUM2INT(args[3]));
+    } else if (name == rb_intern("filter")) {
+        long matrix_size, i;
+
+        args = pipeline_stage_args(ary, 3);
+        Check_Type(args[0], T_ARRAY);
+        matrix_size = RARRAY_LEN(args[0]);
+        if (matrix_size > room) {
+            rb_raise(rb_eArgError, "Invalid pipeline - matrix changed while reading it");
+        }
+        stage->kind = PIPELINE_FILTER;
+        stage->matrix_size = matrix_side(matrix_size);
+        stage->matrix = matrices;
+        for (i = 0; i < matrix_size; i++) {
+            matrices[i] = NUM2DBL(RARRAY_AREF(args[0], i));
+        }
+        stage->divisor = NUM2DBL(args[1]);
+        stage->iterations = NUM2INT(args[2]);
+        if (stage->iterations < 1) {
+            rb_raise(rb_eArgError, "Invalid number of iterations - %i", stage->iterations);
+        }
+        return matrix_size;
+    } else if (name == rb_intern("rotate")) {
+        int angle;
+
+        args = pipeline_stage_args(ary, 1);
+        angle = NUM2INT(args[0]);
+        if (angle != 0 && angle != 90 && angle != 180 && angle != 270) {
+            rb_raise(rb_eArgError, "Invalid angle - %i is not a multiple of 90 between 0 and 270", angle);
+        }
+        stage->kind = PIPELINE_ROTATE;
+        stage->angle = (rotate_angle_t) angle;
+    } else if (name == rb_intern("straighten")) {
+        args = pipeline_stage_args(ary, 1);
+        stage->kind = PIPELINE_STRAIGHTEN;
+        stage->degrees = NUM2DBL(args[0]);
+    } else if (name == rb_intern("crop")) {
+        args = pipeline_stage_args(ary, 5);
+        stage->kind = PIPELINE_CROP;
+        stage->x = NUM2INT(args[0]);
+        stage->y = NUM2INT(args[1]);
+        stage->width = NUM2INT(args[2]);
+        stage->height = NUM2INT(args[3]);
+        stage->fill = NUM2UINT(args[4]);
+        if (stage->width < 1 || stage->height < 1) {
+            rb_raise(rb_eArgError, "Invalid crop size - %ix%i", stage->width, stage->height);
+        }
+    } else if (name == rb_intern("border")) {
+        args = pipeline_stage_args(ary, 6);
+        stage->kind = PIPELINE_BORDER;
+        border_spec_from_ruby(&stage->border, args[0], args[1], args[2], args[3], args[4], args[5]);
+    } else {
+        rb_raise(rb_eArgError, "Invalid pipeline stage - unknown operation %s", rb_id2name(name));
+    }
+
+    return 0;
+}
+
+static VALUE
+Pipeline_CLASS_run(VALUE self OPTIONAL_ATTR, VALUE __v_src OPTIONAL_ATTR, VALUE __v_stages OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    GdkPixbuf *src;
+    GdkPixbuf *__orig_src;
+    __orig_src = src = pixbuf_arg(__v_src);
+    Check_Type(__v_stages, T_ARRAY);
+
+    IGNORE(self);
+    do {
+        VALUE stages_buffer, matrices_buffer;
+        pipeline_stage_t *stages;
+        double *matrices;
+        long n_stages = RARRAY_LEN(__v_stages), n_matrix = 0, used = 0, i;
+        GdkPixbuf *result;
+
+        /* Room for every matrix, counted first so the stages can point into one buffer */
+        for (i = 0; i < n_stages; i++) {
+            VALUE stage = RARRAY_AREF(__v_stages, i);
+            if (RB_TYPE_P(stage, T_ARRAY) && RARRAY_LEN(stage) > 1 && RB_TYPE_P(RARRAY_AREF(stage, 1), T_ARRAY))
+                n_matrix += RARRAY_LEN(RARRAY_AREF(stage, 1));
+        }
+
+        /* Stages carry their tables, so are always too big for ALLOCV_N's stack case */
+        stages = rb_alloc_tmp_buffer2(&stages_buffer, n_stages + 1, sizeof(pipeline_stage_t));
+        matrices = ALLOCV_N(double, matrices_buffer, n_matrix + 1);
+        for (i = 0; i < n_stages; i++) {
+            used += pipeline_stage_from_ruby(&stages[i], RARRAY_AREF(__v_stages, i), matrices + used, n_matrix - used);
+        }
+
+        {
+            pixbuf_op_args_t args = {.src = src, .stages = stages, .n_stages = (int) n_stages};
+            result = without_gvl(pipeline_without_gvl, &args);
+        }
+        ALLOCV_END(stages_buffer);
+        ALLOCV_END(matrices_buffer);
+
+        if (result == NULL) {
+            rb_raise(rb_eNoMemError, "Not enough memory for the pipeline's images");
+        }
+        __p_retval = unref_pixbuf(result);
+    } while (0);
+
+    RB_GC_GUARD(__v_src);
+    RB_GC_GUARD(__v_stages);
+    return __p_retval;
+}
+
+static VALUE
+MorandiNative_CLASS_simd(VALUE self OPTIONAL_ATTR) {
+    IGNORE(self);
+    return rb_str_new2(pixel_kernels->name);
+}
+
+static VALUE
+MorandiNative_CLASS_simd_equals(VALUE self OPTIONAL_ATTR, VALUE __v_level OPTIONAL_ATTR) {
+    const char *level = StringValueCStr(__v_level);
+
+    IGNORE(self);
+    if (!pixel_kernels_select(level)) {
+        rb_raise(rb_eArgError, "Unsupported SIMD level - %s", level);
+    }
+    return __v_level;
+}
+
+static VALUE
+MorandiNative_CLASS_simd_levels(VALUE self OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = rb_ary_new();
+    int i;
+
+    IGNORE(self);
+    for (i = 0; i < PIXEL_KERNEL_LEVELS; i++) {
+        if (pixel_kernels_supported(&pixel_kernel_levels[i]))
+            rb_ary_push(__p_retval, rb_str_new2(pixel_kernel_levels[i].name));
+    }
+    return __p_retval;
+}
+
+static VALUE
+MorandiNative_CLASS_concurrency(VALUE self OPTIONAL_ATTR) {
+    IGNORE(self);
+    return INT2NUM(g_atomic_int_get(&parallel_concurrency));
+}
+
+static VALUE
+MorandiNative_CLASS_concurrency_equals(VALUE self OPTIONAL_ATTR, VALUE __v_concurrency OPTIONAL_ATTR) {
+    int concurrency = NUM2INT(__v_concurrency);
+
+    IGNORE(self);
+    if (concurrency < 1) {
+        rb_raise(rb_eArgError, "Invalid concurrency - %i", concurrency);
+    }
+    parallel_set_concurrency(concurrency);
+    return __v_concurrency;
+}
+
+static VALUE
+MorandiNative_CLASS_icc_cache_size(VALUE self OPTIONAL_ATTR) {
+    int size;
+
+    IGNORE(self);
+    g_mutex_lock(&icc_cache.lock);
+    size = icc_cache.size;
+    g_mutex_unlock(&icc_cache.lock);
+    return INT2NUM(size);
+}
+
+static VALUE
+MorandiNative_CLASS_icc_cache_size_equals(VALUE self OPTIONAL_ATTR, VALUE __v_size OPTIONAL_ATTR) {
+    int size = NUM2INT(__v_size);
+
+    IGNORE(self);
+    if (size < 0) {
+        rb_raise(rb_eArgError, "Invalid ICC cache size - %i", size);
+    }
+    icc_cache_resize(size);
+    return __v_size;
+}
+
+static VALUE
+MorandiNative_CLASS_icc_cache_stats(VALUE self OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = rb_hash_new();
+    guint64 hits, misses;
+    int len;
+
+    IGNORE(self);
+    g_mutex_lock(&icc_cache.lock);
+    hits = icc_cache.hits;
+    misses = icc_cache.misses;
+    len = icc_cache.len;
+    g_mutex_unlock(&icc_cache.lock);
+
+    rb_hash_aset(__p_retval, ID2SYM(rb_intern("hits")), ULL2NUM(hits));
+    rb_hash_aset(__p_retval, ID2SYM(rb_intern("misses")), ULL2NUM(misses));
+    rb_hash_aset(__p_retval, ID2SYM(rb_intern("size")), INT2NUM(len));
     return __p_retval;
 }
 
+static VALUE
+MorandiNative_CLASS_icc_cache_clear(VALUE self OPTIONAL_ATTR) {
+    IGNORE(self);
+    icc_cache_clear();
+    return Qnil;
+}
+
+static VALUE
+MorandiNative_CLASS_icc_lut_after(VALUE self OPTIONAL_ATTR) {
+    int uses;
+
+    IGNORE(self);
+    g_mutex_lock(&icc_cache.lock);
+    uses = icc_cache.lut_after;
+    g_mutex_unlock(&icc_cache.lock);
+    return INT2NUM(uses);
+}
+
+static VALUE
+MorandiNative_CLASS_icc_lut_after_equals(VALUE self OPTIONAL_ATTR, VALUE __v_uses OPTIONAL_ATTR) {
+    int uses = NUM2INT(__v_uses);
+
+    IGNORE(self);
+    if (uses < 0) {
+        rb_raise(rb_eArgError, "Invalid ICC table threshold - %i", uses);
+    }
+    g_mutex_lock(&icc_cache.lock);
+    icc_cache.lut_after = uses;
+    g_mutex_unlock(&icc_cache.lock);
+    return __v_uses;
+}
+
 static VALUE
 RedEye___alloc__(VALUE self OPTIONAL_ATTR) {
     VALUE __p_retval OPTIONAL_ATTR = Qnil;
@@ -768,7 +2222,7 @@ RedEye_initialize(VALUE self OPTIONAL_ATTR, VALUE __v_pixbuf OPTIONAL_ATTR, VALU
     int __orig_maxX;
     int maxY;
     int __orig_maxY;
-    __orig_pixbuf = pixbuf = GDK_PIXBUF(RVAL2GOBJ(__v_pixbuf));
+    __orig_pixbuf = pixbuf = pixbuf_arg(__v_pixbuf);
     __orig_minX = minX = NUM2INT(__v_minX);
     __orig_minY = minY = NUM2INT(__v_minY);
     __orig_maxX = maxX = NUM2INT(__v_maxX);
@@ -793,13 +2247,6 @@ RedEye_initialize(VALUE self OPTIONAL_ATTR, VALUE __v_pixbuf OPTIONAL_ATTR, VALU
         g_assert(op->area.maxY <= gdk_pixbuf_get_height(op->pixbuf));
         g_assert(op->area.minY >= 0);
         g_assert(op->area.minY < op->area.maxY);
-        op->mask = ALLOC_N(
-        int, op->area.width * op->area.height);
-        op->regions.data = ALLOC_N(
-        int, op->area.width * op->area.height);
-        op->regions.region = ALLOC_N(region_info, NO_REGIONS_DEFAULT);
-        op->regions.len = 0;
-        op->regions.size = NO_REGIONS_DEFAULT;
 
     } while (0);
 
@@ -807,6 +2254,14 @@ RedEye_initialize(VALUE self OPTIONAL_ATTR, VALUE __v_pixbuf OPTIONAL_ATTR, VALU
     return Qnil;
 }
 
+static VALUE
+region_struct(VALUE self, const redeyeop_t *op, int id) {
+    const region_info *r = &op->regions.region[id];
+
+    return rb_struct_new(structRegion, self, INT2NUM(id), INT2NUM(r->minX), INT2NUM(r->minY), INT2NUM(r->maxX),
+                         INT2NUM(r->maxY), INT2NUM(r->width), INT2NUM(r->height), INT2NUM(r->noPixels));
+}
+
 static VALUE
 RedEye_identify_blobs(int __p_argc, VALUE *__p_argv, VALUE self) {
     VALUE __p_retval OPTIONAL_ATTR = Qnil;
@@ -842,12 +2297,9 @@ RedEye_identify_blobs(int __p_argc, VALUE *__p_argv, VALUE self) {
     do {
         redeyeop_t *op;
         Data_Get_Struct(self, redeyeop_t, op);
-        MEMZERO(op->mask,
-        int, op->area.width * op->area.height);
-        MEMZERO(op->regions.data,
-        int, op->area.width * op->area.height);
-        identify_possible_redeye_pixels(op, green_sensitivity, blue_sensitivity, min_red_val);
-        identify_blob_groupings(op);
+        redeye_args_t args = {.op = op, .green_sensitivity = green_sensitivity,
+                              .blue_sensitivity = blue_sensitivity, .min_red_val = min_red_val};
+        without_gvl(identify_blobs_without_gvl, &args);
         volatile VALUE ary =
                 rb_ary_new2(op->regions.len);
         int i;
@@ -857,9 +2309,7 @@ RedEye_identify_blobs(int __p_argc, VALUE *__p_argv, VALUE self) {
             region_info *r =
                     &op->regions.region[i];
             /* Ignore CCD noise */ if (r->noPixels < 2) continue;
-            rb_ary_push(ary, rb_struct_new(structRegion, self, INT2NUM(i), INT2NUM(r->minX), INT2NUM(r->minY),
-                                           INT2NUM(r->maxX), INT2NUM(r->maxY), INT2NUM(r->width), INT2NUM(r->height),
-                                           INT2NUM(r->noPixels)));
+            rb_ary_push(ary, region_struct(self, op, i));
         }
         do {
             __p_retval = ary;
@@ -882,9 +2332,10 @@ RedEye_correct_blob(VALUE self OPTIONAL_ATTR, VALUE __v_blob_id OPTIONAL_ATTR) {
     do {
         redeyeop_t *op;
         Data_Get_Struct(self, redeyeop_t, op);
-        if (op->regions.len <= blob_id)
+        if (blob_id < MIN_ID || op->regions.len <= blob_id)
             rb_raise(rb_eIndexError, "Only %i blobs in region - %i is invalid", op->regions.len, blob_id);
-        desaturate_blob(op, blob_id);
+        redeye_args_t args = {.op = op, .blob_id = blob_id};
+        without_gvl(correct_blob_without_gvl, &args);
 
     } while (0);
 
@@ -914,9 +2365,10 @@ RedEye_highlight_blob(int __p_argc, VALUE *__p_argv, VALUE self) {
     do {
         redeyeop_t *op;
         Data_Get_Struct(self, redeyeop_t, op);
-        if (op->regions.len <= blob_id)
+        if (blob_id < MIN_ID || op->regions.len <= blob_id)
             rb_raise(rb_eIndexError, "Only %i blobs in region - %i is invalid", op->regions.len, blob_id);
-        highlight_blob(op, blob_id, col);
+        redeye_args_t args = {.op = op, .blob_id = blob_id, .colour = col};
+        without_gvl(highlight_blob_without_gvl, &args);
 
     } while (0);
 
@@ -955,9 +2407,10 @@ RedEye_preview_blob(int __p_argc, VALUE *__p_argv, VALUE self) {
     do {
         redeyeop_t *op;
         Data_Get_Struct(self, redeyeop_t, op);
-        if (op->regions.len <= blob_id)
+        if (blob_id < MIN_ID || op->regions.len <= blob_id)
             rb_raise(rb_eIndexError, "Only %i blobs in region - %i is invalid", op->regions.len, blob_id);
-        preview_blob(op, blob_id, col, reset_preview);
+        redeye_args_t args = {.op = op, .blob_id = blob_id, .colour = col, .reset_preview = reset_preview};
+        without_gvl(preview_blob_without_gvl, &args);
         do {
             __p_retval = GOBJ2RVAL(GDK_PIXBUF(op->preview));
             goto out;
@@ -1008,6 +2461,146 @@ RedEye_pixbuf(VALUE self OPTIONAL_ATTR) {
     return __p_retval;
 }
 
+/* options[:key], or nil when it is not given */
+static VALUE redeye_option_value(VALUE options, const char *key) {
+    return NIL_P(options) ? Qnil : rb_hash_lookup2(options, ID2SYM(rb_intern(key)), Qnil);
+}
+
+/* options[:key], or fallback when it is not given */
+static double redeye_option(VALUE options, const char *key, double fallback) {
+    VALUE value = redeye_option_value(options, key);
+
+    return NIL_P(value) ? fallback : NUM2DBL(value);
+}
+
+static void redeye_options(VALUE __v_options, redeye_options_t *options) {
+    VALUE proxy;
+
+    if (!NIL_P(__v_options)) {
+        Check_Type(__v_options, T_HASH);
+    }
+
+    options->green_sensitivity = redeye_option(__v_options, "green_sensitivity", 2.0);
+    options->blue_sensitivity = redeye_option(__v_options, "blue_sensitivity", 0.0);
+    options->min_red_val = (int) redeye_option(__v_options, "min_red", MIN_RED_VAL);
+    options->min_pixels = (int) redeye_option(__v_options, "min_pixels", 2);
+    options->min_ratio = redeye_option(__v_options, "min_ratio", 0.5);
+    options->min_density = redeye_option(__v_options, "min_density", RED_AREA_DENSITY_THRESHOLD);
+
+    proxy = redeye_option_value(__v_options, "proxy");
+    if (NIL_P(proxy)) {
+        options->proxy = 1;
+    } else if (FIXNUM_P(proxy) && FIX2LONG(proxy) >= 1 && FIX2LONG(proxy) <= G_MAXINT) {
+        options->proxy = FIX2INT(proxy);
+    } else {
+        rb_raise(rb_eArgError, "Invalid proxy scale %+" PRIsVALUE " - expected a whole number of pixels, at least 1",
+                 proxy);
+    }
+}
+
+static VALUE
+RedEye_find_blobs(int __p_argc, VALUE *__p_argv, VALUE self) {
+    VALUE __p_retval OPTIONAL_ATTR = Qnil;
+    VALUE __v_x = Qnil, __v_y = Qnil, __v_options = Qnil, __v_limit = Qnil;
+
+    /* Scan arguments */
+    rb_scan_args(__p_argc, __p_argv, "22", &__v_x, &__v_y, &__v_options, &__v_limit);
+
+    do {
+        redeyeop_t *op;
+        VALUE __v_blobs_buf, ary;
+        redeye_find_args_t args = {.x = NUM2DBL(__v_x), .y = NUM2DBL(__v_y)};
+        int i;
+
+        Data_Get_Struct(self, redeyeop_t, op);
+        redeye_options(__v_options, &args.options);
+        args.op = op;
+        args.limit = NIL_P(__v_limit) ? 1 : NUM2INT(__v_limit);
+        if (args.limit < 1) {
+            rb_raise(rb_eArgError, "Invalid limit %d - expected at least 1", args.limit);
+        }
+
+        args.blobs = ALLOCV_N(int, __v_blobs_buf, MIN(args.limit, op->area.width * op->area.height));
+        without_gvl(find_blobs_without_gvl, &args);
+
+        ary = rb_ary_new2(args.n_blobs);
+        for (i = 0; i < args.n_blobs; i++)
+            rb_ary_push(ary, region_struct(self, op, args.blobs[i]));
+        ALLOCV_END(__v_blobs_buf);
+
+        __p_retval = ary;
+    } while (0);
+
+    return __p_retval;
+}
+
+static VALUE
+RedEye_CLASS_correct_taps(VALUE self OPTIONAL_ATTR, VALUE __v_pixbuf OPTIONAL_ATTR, VALUE __v_points OPTIONAL_ATTR,
+                          VALUE __v_options OPTIONAL_ATTR) {
+    GdkPixbuf *pixbuf;
+    GdkPixbuf *__orig_pixbuf;
+    IGNORE(self);
+    __orig_pixbuf = pixbuf = pixbuf_arg(__v_pixbuf);
+    Check_Type(__v_points, T_ARRAY);
+
+    do {
+        VALUE __v_taps_buf;
+        int width = gdk_pixbuf_get_width(pixbuf), height = gdk_pixbuf_get_height(pixbuf);
+        /* Taps search a tenth of the image's longer side around them */
+        int radius = MAX(width, height) / 10;
+        long n_points = RARRAY_LEN(__v_points), i;
+        redeye_tap_t *taps = ALLOCV_N(redeye_tap_t, __v_taps_buf, n_points);
+        redeye_taps_args_t args = {.pixbuf = pixbuf, .taps = taps, .n_taps = 0};
+
+        for (i = 0; i < n_points; i++) {
+            VALUE point = RARRAY_AREF(__v_points, i);
+            redeye_tap_t *tap = &taps[args.n_taps];
+            double x, y;
+
+            Check_Type(point, T_ARRAY);
+            if (RARRAY_LEN(point) != 2) {
+                rb_raise(rb_eArgError, "Invalid tap - expected [x, y]");
+            }
+            x = NUM2DBL(RARRAY_AREF(point, 0));
+            y = NUM2DBL(RARRAY_AREF(point, 1));
+
+            tap->minX = (int) MAX(x - radius, 0);
+            tap->minY = (int) MAX(y - radius, 0);
+            tap->maxX = (int) MIN(x + radius, width);
+            tap->maxY = (int) MIN(y + radius, height);
+            /* Taps too far off the image have nowhere to search */
+            if (tap->maxX > tap->minX && tap->maxY > tap->minY)
+                args.n_taps++;
+        }
+
+        redeye_options(__v_options, &args.options);
+
+        if (args.n_taps > 0)
+            without_gvl(correct_taps_without_gvl, &args);
+        ALLOCV_END(__v_taps_buf);
+    } while (0);
+
+    RB_GC_GUARD(__v_pixbuf);
+    return __v_pixbuf;
+}
+
+/* How many pixels correct_taps has checked for red so far, on the proxy and at full size */
+static VALUE
+RedEye_CLASS_search_stats(VALUE self OPTIONAL_ATTR) {
+    VALUE __p_retval OPTIONAL_ATTR = rb_hash_new();
+    guint64 sampled, thresholded;
+
+    IGNORE(self);
+    g_mutex_lock(&redeye_search_stats.lock);
+    sampled = redeye_search_stats.sampled;
+    thresholded = redeye_search_stats.thresholded;
+    g_mutex_unlock(&redeye_search_stats.lock);
+
+    rb_hash_aset(__p_retval, ID2SYM(rb_intern("sampled")), ULL2NUM(sampled));
+    rb_hash_aset(__p_retval, ID2SYM(rb_intern("thresholded")), ULL2NUM(thresholded));
+    return __p_retval;
+}
+
 static VALUE
 Region_ratio(VALUE self OPTIONAL_ATTR) {
     VALUE __p_retval OPTIONAL_ATTR = Qnil;
@@ -1075,17 +2668,12 @@ Region_squareish_query(int __p_argc, VALUE *__p_argv, VALUE self) {
     else
         min_density = 0.5;
 
-    int noPixels, width, height;
-    double min, max, ratio, density;
-    noPixels = NUM2INT(rb_struct_getmember(self, rb_intern("noPixels")));
-    width = NUM2INT(rb_struct_getmember(self, rb_intern("width")));
-    height = NUM2INT(rb_struct_getmember(self, rb_intern("height")));
-    min = (double) MIN(width, height);
-    max = (double) MAX(width, height);
-    ratio = (min / max);
-    density = ((double) noPixels / (double) (width * height));
+    region_info r;
+    r.noPixels = NUM2INT(rb_struct_getmember(self, rb_intern("noPixels")));
+    r.width = NUM2INT(rb_struct_getmember(self, rb_intern("width")));
+    r.height = NUM2INT(rb_struct_getmember(self, rb_intern("height")));
     do {
-        __p_retval = ((((ratio >= min_ratio) && (density > min_density))) ? Qtrue : Qfalse);
+        __p_retval = region_squareish(&r, min_ratio, min_density) ? Qtrue : Qfalse;
         goto out;
     }
     while (0);
@@ -1096,15 +2684,44 @@ Region_squareish_query(int __p_argc, VALUE *__p_argv, VALUE self) {
 /* Init */
 void
 Init_morandi_native(void) {
+    pixel_kernels_init();
+    parallel_init();
+
     mMorandiNative = rb_define_module("MorandiNative");
+    rb_define_singleton_method(mMorandiNative, "simd", MorandiNative_CLASS_simd, 0);
+    rb_define_singleton_method(mMorandiNative, "simd=", MorandiNative_CLASS_simd_equals, 1);
+    rb_define_singleton_method(mMorandiNative, "simd_levels", MorandiNative_CLASS_simd_levels, 0);
+    rb_define_singleton_method(mMorandiNative, "concurrency", MorandiNative_CLASS_concurrency, 0);
+    rb_define_singleton_method(mMorandiNative, "concurrency=", MorandiNative_CLASS_concurrency_equals, 1);
+    rb_define_singleton_method(mMorandiNative, "icc_cache_size", MorandiNative_CLASS_icc_cache_size, 0);
+    rb_define_singleton_method(mMorandiNative, "icc_cache_size=", MorandiNative_CLASS_icc_cache_size_equals, 1);
+    rb_define_singleton_method(mMorandiNative, "icc_cache_stats", MorandiNative_CLASS_icc_cache_stats, 0);
+    rb_define_singleton_method(mMorandiNative, "icc_cache_clear", MorandiNative_CLASS_icc_cache_clear, 0);
+    rb_define_singleton_method(mMorandiNative, "icc_lut_after", MorandiNative_CLASS_icc_lut_after, 0);
+    rb_define_singleton_method(mMorandiNative, "icc_lut_after=", MorandiNative_CLASS_icc_lut_after_equals, 1);
     mPixbufUtils = rb_define_module_under(mMorandiNative, "PixbufUtils");
     rb_define_singleton_method(mPixbufUtils, "contrast", PixbufUtils_CLASS_contrast, 2);
     rb_define_singleton_method(mPixbufUtils, "brightness", PixbufUtils_CLASS_brightness, 2);
-    rb_define_singleton_method(mPixbufUtils, "filter", PixbufUtils_CLASS_filter, 3);
+    rb_define_singleton_method(mPixbufUtils, "filter", PixbufUtils_CLASS_filter, -1);
     rb_define_singleton_method(mPixbufUtils, "rotate", PixbufUtils_CLASS_rotate, 2);
+    rb_define_singleton_method(mPixbufUtils, "straighten", PixbufUtils_CLASS_straighten, 2);
+    rb_define_singleton_method(mPixbufUtils, "crop_fill", PixbufUtils_CLASS_crop_fill, -1);
+    rb_define_singleton_method(mPixbufUtils, "border", PixbufUtils_CLASS_border, 7);
     rb_define_singleton_method(mPixbufUtils, "gamma", PixbufUtils_CLASS_gamma, 2);
     rb_define_singleton_method(mPixbufUtils, "tint", PixbufUtils_CLASS_tint, -1);
     rb_define_singleton_method(mPixbufUtils, "mask", PixbufUtils_CLASS_mask, 2);
+    rb_define_singleton_method(mPixbufUtils, "colour_lut", PixbufUtils_CLASS_colour_lut, 4);
+    rb_define_singleton_method(mPixbufUtils, "contrast!", PixbufUtils_CLASS_contrast_bang, 2);
+    rb_define_singleton_method(mPixbufUtils, "brightness!", PixbufUtils_CLASS_brightness_bang, 2);
+    rb_define_singleton_method(mPixbufUtils, "gamma!", PixbufUtils_CLASS_gamma_bang, 2);
+    rb_define_singleton_method(mPixbufUtils, "icc_to_srgb!", PixbufUtils_CLASS_icc_to_srgb_bang, -1);
+    rb_define_singleton_method(mPixbufUtils, "load_jpeg_region", PixbufUtils_CLASS_load_jpeg_region, 5);
+    /* Whether load_jpeg_region can decode anything, as it needs libjpeg-turbo 1.5 or later */
+    rb_define_const(mPixbufUtils, "JPEG_REGIONS", JPEG_REGIONS ? Qtrue : Qfalse);
+    rb_define_singleton_method(mPixbufUtils, "tint!", PixbufUtils_CLASS_tint_bang, -1);
+    rb_define_singleton_method(mPixbufUtils, "colour_lut!", PixbufUtils_CLASS_colour_lut_bang, 4);
+    cPipeline = rb_define_class_under(mMorandiNative, "Pipeline", rb_cObject);
+    rb_define_singleton_method(cPipeline, "run", Pipeline_CLASS_run, 2);
 
 
 
@@ -1112,11 +2729,15 @@ Init_morandi_native(void) {
     rb_define_alloc_func(cRedEye, RedEye___alloc__);
     rb_define_method(cRedEye, "initialize", RedEye_initialize, 5);
     rb_define_method(cRedEye, "identify_blobs", RedEye_identify_blobs, -1);
+    rb_define_method(cRedEye, "find_blobs", RedEye_find_blobs, -1);
     rb_define_method(cRedEye, "correct_blob", RedEye_correct_blob, 1);
     rb_define_method(cRedEye, "highlight_blob", RedEye_highlight_blob, -1);
     rb_define_method(cRedEye, "preview_blob", RedEye_preview_blob, -1);
     rb_define_method(cRedEye, "preview", RedEye_preview, 0);
     rb_define_method(cRedEye, "pixbuf", RedEye_pixbuf, 0);
+    rb_define_singleton_method(cRedEye, "correct_taps", RedEye_CLASS_correct_taps, 3);
+    rb_define_singleton_method(cRedEye, "search_stats", RedEye_CLASS_search_stats, 0);
+    rb_define_const(cRedEye, "RED_AREA_DENSITY_THRESHOLD", rb_float_new(RED_AREA_DENSITY_THRESHOLD));
     structRegion = rb_struct_define_under(cRedEye, "Region", "op", "id", "minX", "minY", "maxX", "maxY", "width", "height", "noPixels",
                                     NULL);
     // rb_define_const(cRedEye, "Region", structRegion);
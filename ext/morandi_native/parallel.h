@@ -0,0 +1,122 @@
+/*
+ * Row band parallelism
+ *
+ * Kernels hand parallel_rows() a callback that processes rows y0..y1-1 of the
+ * output. The rows are split into bands; all but the first are queued on a
+ * shared thread pool, the calling thread works through the first itself and
+ * then waits for the others. A band only writes its own rows of the
+ * destination, so bands need no locking. Kernels that look at neighbouring
+ * rows (convolution) read them from the source, never from another band's
+ * output.
+ */
+
+typedef void (*band_func_t)(void *data, int y0, int y1);
+
+/* Bands smaller than this are not worth handing to another thread */
+#define PARALLEL_MIN_BAND_PIXELS (64 * 1024)
+
+typedef struct {
+    band_func_t func;
+    void *data;
+    GMutex lock;
+    GCond done;
+    int pending;
+} band_job_t;
+
+typedef struct {
+    band_job_t *job;
+    int y0, y1;
+} band_t;
+
+static int parallel_concurrency = 1;
+static GThreadPool *parallel_pool = NULL;
+static pid_t parallel_pool_pid;
+static GMutex parallel_pool_lock;
+
+static void parallel_run_band(gpointer task, gpointer user_data) {
+    band_t *band = task;
+    band_job_t *job = band->job;
+
+    job->func(job->data, band->y0, band->y1);
+
+    g_mutex_lock(&job->lock);
+    if (--job->pending == 0)
+        g_cond_signal(&job->done);
+    g_mutex_unlock(&job->lock);
+}
+
+/*
+ * The pool's threads do not survive fork(), so a forked child (e.g. a Puma or
+ * Unicorn worker) starts its own pool rather than queueing onto the parent's.
+ */
+static GThreadPool *parallel_get_pool(void) {
+    GThreadPool *pool;
+
+    g_mutex_lock(&parallel_pool_lock);
+    if (parallel_pool == NULL || parallel_pool_pid != getpid()) {
+        parallel_pool = g_thread_pool_new(parallel_run_band, NULL, MAX(parallel_concurrency - 1, 1), TRUE, NULL);
+        parallel_pool_pid = getpid();
+    }
+    pool = parallel_pool;
+    g_mutex_unlock(&parallel_pool_lock);
+
+    return pool;
+}
+
+static void parallel_set_concurrency(int concurrency) {
+    g_mutex_lock(&parallel_pool_lock);
+    g_atomic_int_set(&parallel_concurrency, concurrency);
+    if (parallel_pool != NULL && parallel_pool_pid == getpid())
+        g_thread_pool_set_max_threads(parallel_pool, MAX(concurrency - 1, 1), NULL);
+    g_mutex_unlock(&parallel_pool_lock);
+}
+
+static void parallel_init(void) {
+    parallel_concurrency = MAX((int) g_get_num_processors(), 1);
+}
+
+/* Calls func over rows 0..height-1 of a width pixel wide image, in parallel bands where worthwhile */
+static void parallel_rows(int height, int width, band_func_t func, void *data) {
+    band_job_t job;
+    band_t *bands;
+    GThreadPool *pool;
+    int n_bands, i;
+
+    n_bands = MIN(g_atomic_int_get(&parallel_concurrency), height);
+    n_bands = (int) MIN((gint64) n_bands, ((gint64) width * height) / PARALLEL_MIN_BAND_PIXELS);
+
+    if (n_bands <= 1) {
+        if (height > 0)
+            func(data, 0, height);
+        return;
+    }
+
+    pool = parallel_get_pool();
+
+    job.func = func;
+    job.data = data;
+    job.pending = n_bands - 1;
+    g_mutex_init(&job.lock);
+    g_cond_init(&job.done);
+
+    bands = g_new(band_t, n_bands);
+    for (i = 0; i < n_bands; i++) {
+        bands[i].job = &job;
+        bands[i].y0 = (int) (((gint64) height * i) / n_bands);
+        bands[i].y1 = (int) (((gint64) height * (i + 1)) / n_bands);
+    }
+
+    for (i = 1; i < n_bands; i++)
+        g_thread_pool_push(pool, &bands[i], NULL);
+
+    func(data, bands[0].y0, bands[0].y1);
+
+    g_mutex_lock(&job.lock);
+    while (job.pending > 0)
+        g_cond_wait(&job.done, &job.lock);
+    g_mutex_unlock(&job.lock);
+
+    g_mutex_clear(&job.lock);
+    g_cond_clear(&job.done);
+    g_free(bands);
+}
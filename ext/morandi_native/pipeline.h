@@ -0,0 +1,246 @@
+/*
+ * Whole-image pipelines, as planned by MorandiNative::Pipeline
+ *
+ * Runs a list of stages over an image without handing each intermediate
+ * back to Ruby. At most two working images are alive at once: the current
+ * one, and a spare that the next stage writes into when the sizes match.
+ * Images made here are written in place where the stage allows it, the
+ * caller's source never is, and in-bounds crops are views rather than
+ * copies. Runs of adjacent point operations are applied together, a few
+ * rows at a time, so each row is read and written once while in cache.
+ */
+
+#define PIPELINE_POINT_ROWS 16
+
+typedef enum {
+    PIPELINE_COLOUR_LUT,
+    PIPELINE_TINT,
+    PIPELINE_FILTER,
+    PIPELINE_ROTATE,
+    PIPELINE_STRAIGHTEN,
+    PIPELINE_CROP,
+    PIPELINE_BORDER
+} pipeline_stage_kind_t;
+
+typedef struct {
+    pipeline_stage_kind_t kind;
+    /* colour_lut */
+    guchar map[256], alpha_map[256];
+    gboolean map_alpha;
+    lut_rows_t lut;
+    /* tint */
+    tint_rows_t tint;
+    /* filter */
+    double *matrix, divisor;
+    int matrix_size, iterations;
+    /* rotate, straighten */
+    rotate_angle_t angle;
+    double degrees;
+    /* crop */
+    int x, y, width, height;
+    guint32 fill;
+    /* border */
+    border_spec_t border;
+} pipeline_stage_t;
+
+typedef struct {
+    GdkPixbuf *current;
+    /* current was made here (or is a view of something that was), so may be written to */
+    gboolean owned;
+    GdkPixbuf *spare;
+} pipeline_state_t;
+
+/* An image to write the next stage into: the spare if it is the right shape, otherwise a new one */
+static GdkPixbuf *pipeline_buffer(pipeline_state_t *state, gboolean has_alpha, int width, int height) {
+    GdkPixbuf *buffer = state->spare;
+
+    state->spare = NULL;
+    if (buffer != NULL) {
+        if (gdk_pixbuf_get_width(buffer) == width && gdk_pixbuf_get_height(buffer) == height &&
+            gdk_pixbuf_get_has_alpha(buffer) == has_alpha)
+            return buffer;
+        g_object_unref(buffer);
+    }
+
+    return gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+}
+
+/* Makes next the current image, keeping the old one as the spare if it was made here */
+static void pipeline_advance(pipeline_state_t *state, GdkPixbuf *next) {
+    if (state->owned) {
+        if (state->spare != NULL)
+            g_object_unref(state->spare);
+        state->spare = state->current;
+    } else {
+        g_object_unref(state->current);
+    }
+
+    state->current = next;
+    state->owned = TRUE;
+}
+
+static gboolean pipeline_point_stage(const pipeline_stage_t *stage) {
+    return stage->kind == PIPELINE_COLOUR_LUT || stage->kind == PIPELINE_TINT;
+}
+
+typedef struct {
+    pipeline_stage_t *stages;
+    int n_stages;
+} pipeline_points_t;
+
+static void pipeline_points_band(void *data, int y0, int y1) {
+    pipeline_points_t *points = data;
+    int y, i;
+
+    for (y = y0; y < y1; y += PIPELINE_POINT_ROWS) {
+        int y_end = MIN(y + PIPELINE_POINT_ROWS, y1);
+
+        for (i = 0; i < points->n_stages; i++) {
+            pipeline_stage_t *stage = &points->stages[i];
+
+            if (stage->kind == PIPELINE_COLOUR_LUT)
+                lut_rows_band(&stage->lut, y, y_end);
+            else
+                tint_band(&stage->tint, y, y_end);
+        }
+    }
+}
+
+/* Applies n adjacent point stages in one pass; the first reads the current image, the rest its output */
+static gboolean pipeline_points(pipeline_state_t *state, pipeline_stage_t *stages, int n) {
+    pipeline_points_t points = {stages, n};
+    GdkPixbuf *src = state->current, *dest;
+    int i;
+
+    if (state->owned) {
+        dest = src;
+    } else {
+        dest = pipeline_buffer(state, gdk_pixbuf_get_has_alpha(src), gdk_pixbuf_get_width(src),
+                               gdk_pixbuf_get_height(src));
+        if (dest == NULL)
+            return FALSE;
+    }
+
+    for (i = 0; i < n; i++) {
+        pixel_rows_t *rows = (stages[i].kind == PIPELINE_COLOUR_LUT) ? &stages[i].lut.rows : &stages[i].tint.rows;
+
+        pixel_rows_init(rows, (i == 0) ? src : dest, dest);
+        if (stages[i].kind == PIPELINE_COLOUR_LUT) {
+            stages[i].lut.lut = stages[i].map;
+            stages[i].lut.alpha_lut = stages[i].map_alpha ? stages[i].alpha_map : NULL;
+        }
+    }
+
+    parallel_rows(gdk_pixbuf_get_height(src), gdk_pixbuf_get_width(src), pipeline_points_band, &points);
+
+    if (dest != src)
+        pipeline_advance(state, dest);
+
+    return TRUE;
+}
+
+/* Crops in bounds are views of the current image; the rest are filled around */
+static gboolean pipeline_crop(pipeline_state_t *state, const pipeline_stage_t *stage) {
+    GdkPixbuf *src = state->current, *dest;
+    int s_width = gdk_pixbuf_get_width(src), s_height = gdk_pixbuf_get_height(src);
+
+    if (stage->x < 0 || stage->y < 0 || stage->x + stage->width > s_width || stage->y + stage->height > s_height) {
+        dest = pipeline_buffer(state, FALSE, stage->width, stage->height);
+        if (dest == NULL)
+            return FALSE;
+        pixbuf_crop_fill_into(src, dest, stage->x, stage->y, stage->fill);
+        pipeline_advance(state, dest);
+        return TRUE;
+    }
+
+    /* The view holds its own reference to the image it looks into, which stays owned or not */
+    dest = gdk_pixbuf_new_subpixbuf(src, stage->x, stage->y, stage->width, stage->height);
+    if (dest == NULL)
+        return FALSE;
+    g_object_unref(src);
+    state->current = dest;
+
+    return TRUE;
+}
+
+static gboolean pipeline_stage(pipeline_state_t *state, pipeline_stage_t *stage) {
+    GdkPixbuf *src = state->current, *dest;
+    int width = gdk_pixbuf_get_width(src), height = gdk_pixbuf_get_height(src);
+    gboolean has_alpha = gdk_pixbuf_get_has_alpha(src);
+    int i, d_width, d_height;
+
+    switch (stage->kind) {
+        case PIPELINE_FILTER:
+            /* Passes alternate between two images, as the spare comes back round */
+            for (i = 0; i < stage->iterations; i++) {
+                dest = pipeline_buffer(state, has_alpha, width, height);
+                if (dest == NULL)
+                    return FALSE;
+                pixbuf_convolution_matrix(state->current, dest, stage->matrix_size, stage->matrix, stage->divisor);
+                pipeline_advance(state, dest);
+            }
+            return TRUE;
+
+        case PIPELINE_ROTATE:
+            rotate_size(stage->angle, width, height, &d_width, &d_height);
+            dest = pipeline_buffer(state, has_alpha, d_width, d_height);
+            if (dest == NULL)
+                return FALSE;
+            pixbuf_rotate_into(src, dest, stage->angle);
+            break;
+
+        case PIPELINE_STRAIGHTEN:
+            dest = pipeline_buffer(state, FALSE, width, height);
+            if (dest == NULL)
+                return FALSE;
+            pixbuf_straighten_into(src, dest, stage->degrees);
+            break;
+
+        case PIPELINE_CROP:
+            return pipeline_crop(state, stage);
+
+        case PIPELINE_BORDER:
+            dest = pipeline_buffer(state, FALSE, width, height);
+            if (dest == NULL)
+                return FALSE;
+            pixbuf_border_into(src, dest, &stage->border);
+            break;
+
+        default:
+            return pipeline_points(state, stage, 1);
+    }
+
+    pipeline_advance(state, dest);
+    return TRUE;
+}
+
+/* Runs the stages over src, returning a new reference to the result, or NULL when out of memory */
+static GdkPixbuf *pipeline_run(GdkPixbuf *src, pipeline_stage_t *stages, int n_stages) {
+    pipeline_state_t state = {g_object_ref(src), FALSE, NULL};
+    gboolean ok = TRUE;
+    int i = 0;
+
+    while (ok && i < n_stages) {
+        int n = 0;
+
+        while (i + n < n_stages && pipeline_point_stage(&stages[i + n]))
+            n++;
+
+        if (n > 0) {
+            ok = pipeline_points(&state, &stages[i], n);
+            i += n;
+        } else {
+            ok = pipeline_stage(&state, &stages[i]);
+            i++;
+        }
+    }
+
+    if (state.spare != NULL)
+        g_object_unref(state.spare);
+    if (!ok) {
+        g_object_unref(state.current);
+        return NULL;
+    }
+
+    return state.current;
+}
@@ -0,0 +1,300 @@
+/*
+ * Runtime-dispatched row kernels
+ *
+ * The pixel loops call through `pixel_kernels`, which is pointed at the best
+ * implementation the CPU supports when the extension is loaded. Every
+ * implementation must produce exactly the same bytes as the scalar one; the
+ * specs compare each available level against "scalar".
+ *
+ * - add_row: brightness; saturating byte adds (SSE2, AVX2, NEON)
+ * - grey_row: tint luminance; the double precision products are looked up
+ *   from tables and gathered four pixels at a time with AVX2
+ * - lut_row: contrast and gamma; a byte table lookup, which SSE2 and NEON
+ *   cannot do any faster than the scalar loop as they have no byte gather
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MORANDI_SIMD_X86 1
+#include <immintrin.h>
+#define MORANDI_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__aarch64__)
+#define MORANDI_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define RLUM    (0.3086)
+#define GLUM    (0.6094)
+#define BLUM    (0.0820)
+
+// Graphica Obscure
+#define GO_RGB_TO_GREY(r, g, b) ((int)((RLUM * (double)r) + (GLUM * (double)g) + (BLUM * (double)b)))
+
+typedef struct {
+    double r[256], g[256], b[256];
+} grey_tables_t;
+
+static grey_tables_t grey_tables;
+
+typedef struct {
+    const char *name;
+    /* dp = clamp(sp + mod) for the colour channels, alpha is copied */
+    void (*add_row)(guchar *dp, const guchar *sp, int width, int pix_width, int mod);
+    /* grey[j] = GO_RGB_TO_GREY of pixel j */
+    void (*grey_row)(guchar *grey, const guchar *sp, int width, int pix_width);
+    /* dp = lut[sp] for the colour channels, alpha_lut[sp] for alpha (copied when NULL) */
+    void (*lut_row)(guchar *dp, const guchar *sp, int width, int pix_width, const guchar *lut,
+                    const guchar *alpha_lut);
+} pixel_kernels_t;
+
+static const pixel_kernels_t *pixel_kernels;
+
+/* Scalar */
+
+static void add_bytes_scalar(guchar *dp, const guchar *sp, int from, int to, int pix_width, int mod) {
+    int i;
+
+    for (i = from; i < to; i++) {
+        if (pix_width == 4 && (i & 3) == 3)
+            dp[i] = sp[i];    /* alpha */
+        else
+            dp[i] = CLAMP(mod + sp[i], 0, 255);
+    }
+}
+
+static void add_row_scalar(guchar *dp, const guchar *sp, int width, int pix_width, int mod) {
+    add_bytes_scalar(dp, sp, 0, width * pix_width, pix_width, mod);
+}
+
+static void grey_row_scalar(guchar *grey, const guchar *sp, int width, int pix_width) {
+    int j;
+
+    for (j = 0; j < width; j++) {
+        grey[j] = GO_RGB_TO_GREY(sp[0], sp[1], sp[2]);
+        sp += pix_width;
+    }
+}
+
+static void lut_row_scalar(guchar *dp, const guchar *sp, int width, int pix_width, const guchar *lut,
+                           const guchar *alpha_lut) {
+    int j;
+
+    for (j = 0; j < width; j++) {
+        dp[0] = lut[sp[0]];    /* red */
+        dp[1] = lut[sp[1]];    /* green */
+        dp[2] = lut[sp[2]];    /* blue */
+        if (pix_width == 4)
+            dp[3] = alpha_lut ? alpha_lut[sp[3]] : sp[3];    /* alpha */
+        dp += pix_width;
+        sp += pix_width;
+    }
+}
+
+/* Saturating adds clamp exactly like pix_value(), as long as the step fits in a byte */
+static void add_pattern(guchar pattern[32], int pix_width, int mod) {
+    int i, step = MIN(abs(mod), 255);
+
+    for (i = 0; i < 32; i++)
+        pattern[i] = (pix_width == 4 && (i & 3) == 3) ? 0 : step;
+}
+
+#ifdef MORANDI_SIMD_X86
+
+MORANDI_TARGET("sse2")
+static void add_row_sse2(guchar *dp, const guchar *sp, int width, int pix_width, int mod) {
+    guchar pattern[32];
+    int i = 0, n = width * pix_width;
+    __m128i step;
+
+    add_pattern(pattern, pix_width, mod);
+    step = _mm_loadu_si128((const __m128i *) pattern);
+
+    if (mod >= 0) {
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i *) (dp + i), _mm_adds_epu8(_mm_loadu_si128((const __m128i *) (sp + i)), step));
+    } else {
+        for (; i + 16 <= n; i += 16)
+            _mm_storeu_si128((__m128i *) (dp + i), _mm_subs_epu8(_mm_loadu_si128((const __m128i *) (sp + i)), step));
+    }
+
+    add_bytes_scalar(dp, sp, i, n, pix_width, mod);
+}
+
+MORANDI_TARGET("avx2")
+static void add_row_avx2(guchar *dp, const guchar *sp, int width, int pix_width, int mod) {
+    guchar pattern[32];
+    int i = 0, n = width * pix_width;
+    __m256i step;
+
+    add_pattern(pattern, pix_width, mod);
+    step = _mm256_loadu_si256((const __m256i *) pattern);
+
+    if (mod >= 0) {
+        for (; i + 32 <= n; i += 32)
+            _mm256_storeu_si256((__m256i *) (dp + i),
+                                _mm256_adds_epu8(_mm256_loadu_si256((const __m256i *) (sp + i)), step));
+    } else {
+        for (; i + 32 <= n; i += 32)
+            _mm256_storeu_si256((__m256i *) (dp + i),
+                                _mm256_subs_epu8(_mm256_loadu_si256((const __m256i *) (sp + i)), step));
+    }
+
+    add_bytes_scalar(dp, sp, i, n, pix_width, mod);
+}
+
+/*
+ * Gathers the three products for four pixels at a time from tables filled
+ * with the same multiplications as GO_RGB_TO_GREY, then adds them in the same
+ * order. That is only bit-for-bit identical while the scalar expression is not
+ * contracted into fused multiply-adds, so it is left out of FMA builds.
+ */
+#ifndef __FMA__
+#define MORANDI_GREY_ROW_AVX2 grey_row_avx2
+
+MORANDI_TARGET("avx2")
+static void grey_row_avx2(guchar *grey, const guchar *sp, int width, int pix_width) {
+    const __m128i byte_mask = _mm_set1_epi32(0xff);
+    int j = 0;
+
+    /* Each pixel is read as 32 bits, so stop while a whole pixel remains after the last one */
+    for (; j + 5 <= width; j += 4) {
+        __m128i px, r, g, b, result;
+        __m256d sum;
+        gint32 lanes[4];
+        int k;
+
+        for (k = 0; k < 4; k++)
+            memcpy(&lanes[k], sp + ((j + k) * pix_width), 4);
+        px = _mm_loadu_si128((const __m128i *) lanes);
+
+        r = _mm_and_si128(px, byte_mask);
+        g = _mm_and_si128(_mm_srli_epi32(px, 8), byte_mask);
+        b = _mm_and_si128(_mm_srli_epi32(px, 16), byte_mask);
+
+        sum = _mm256_add_pd(_mm256_i32gather_pd(grey_tables.r, r, 8), _mm256_i32gather_pd(grey_tables.g, g, 8));
+        sum = _mm256_add_pd(sum, _mm256_i32gather_pd(grey_tables.b, b, 8));
+        result = _mm256_cvttpd_epi32(sum);
+
+        _mm_storeu_si128((__m128i *) lanes, result);
+        for (k = 0; k < 4; k++)
+            grey[j + k] = lanes[k];
+    }
+
+    grey_row_scalar(grey + j, sp + (j * pix_width), width - j, pix_width);
+}
+#else
+#define MORANDI_GREY_ROW_AVX2 grey_row_scalar
+#endif /* __FMA__ */
+
+#endif /* MORANDI_SIMD_X86 */
+
+#ifdef MORANDI_SIMD_NEON
+
+static void add_row_neon(guchar *dp, const guchar *sp, int width, int pix_width, int mod) {
+    guchar pattern[32];
+    int i = 0, n = width * pix_width;
+    uint8x16_t step;
+
+    add_pattern(pattern, pix_width, mod);
+    step = vld1q_u8(pattern);
+
+    if (mod >= 0) {
+        for (; i + 16 <= n; i += 16)
+            vst1q_u8(dp + i, vqaddq_u8(vld1q_u8(sp + i), step));
+    } else {
+        for (; i + 16 <= n; i += 16)
+            vst1q_u8(dp + i, vqsubq_u8(vld1q_u8(sp + i), step));
+    }
+
+    add_bytes_scalar(dp, sp, i, n, pix_width, mod);
+}
+
+#endif /* MORANDI_SIMD_NEON */
+
+static const pixel_kernels_t pixel_kernel_levels[] = {
+#ifdef MORANDI_SIMD_X86
+    {"avx2", add_row_avx2, MORANDI_GREY_ROW_AVX2, lut_row_scalar},
+    {"sse2", add_row_sse2, grey_row_scalar, lut_row_scalar},
+#endif
+#ifdef MORANDI_SIMD_NEON
+    {"neon", add_row_neon, grey_row_scalar, lut_row_scalar},
+#endif
+    {"scalar", add_row_scalar, grey_row_scalar, lut_row_scalar},
+};
+
+#define PIXEL_KERNEL_LEVELS ((int) (sizeof(pixel_kernel_levels) / sizeof(pixel_kernel_levels[0])))
+
+static gboolean pixel_kernels_supported(const pixel_kernels_t *kernels) {
+#ifdef MORANDI_SIMD_X86
+    if (strcmp(kernels->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(kernels->name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return TRUE;
+}
+
+/* Selects kernels by name, or the best supported ones when name is NULL */
+static gboolean pixel_kernels_select(const char *name) {
+    int i;
+
+    for (i = 0; i < PIXEL_KERNEL_LEVELS; i++) {
+        if (name && strcmp(name, pixel_kernel_levels[i].name) != 0)
+            continue;
+        if (!pixel_kernels_supported(&pixel_kernel_levels[i]))
+            continue;
+
+        pixel_kernels = &pixel_kernel_levels[i];
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void pixel_kernels_init(void) {
+    int i;
+
+#ifdef MORANDI_SIMD_X86
+    __builtin_cpu_init();
+#endif
+
+    for (i = 0; i < 256; i++) {
+        grey_tables.r[i] = RLUM * (double) i;
+        grey_tables.g[i] = GLUM * (double) i;
+        grey_tables.b[i] = BLUM * (double) i;
+    }
+
+    pixel_kernels_select(NULL);
+}
+
+/* Source and destination rows for the per-pixel kernels */
+typedef struct {
+    const guchar *s_pix;
+    guchar *d_pix;
+    int s_rowstride, d_rowstride;
+    int width, pix_width;
+} pixel_rows_t;
+
+static void pixel_rows_init(pixel_rows_t *rows, GdkPixbuf *src, GdkPixbuf *dest) {
+    rows->s_pix = gdk_pixbuf_get_pixels(src);
+    rows->d_pix = gdk_pixbuf_get_pixels(dest);
+    rows->s_rowstride = gdk_pixbuf_get_rowstride(src);
+    rows->d_rowstride = gdk_pixbuf_get_rowstride(dest);
+    rows->width = gdk_pixbuf_get_width(src);
+    rows->pix_width = gdk_pixbuf_get_has_alpha(src) ? 4 : 3;
+}
+
+/* Table lookups, shared by contrast and gamma */
+typedef struct {
+    pixel_rows_t rows;
+    const guchar *lut, *alpha_lut;
+} lut_rows_t;
+
+static void lut_rows_band(void *data, int y0, int y1) {
+    lut_rows_t *op = data;
+    int i;
+
+    for (i = y0; i < y1; i++) {
+        pixel_kernels->lut_row(op->rows.d_pix + (i * op->rows.d_rowstride), op->rows.s_pix + (i * op->rows.s_rowstride),
+                               op->rows.width, op->rows.pix_width, op->lut, op->alpha_lut);
+    }
+}
@@ -42,7 +42,10 @@ module Cairo
   # Add Cairo::Context#set_source_pixbuf without gtk2 depdendency
   class Context
     def set_source_pixbuf(pixbuf, x = 0, y = 0)
-      set_source(pixbuf.to_cairo_image_surface, x, y)
+      surface = pixbuf.to_cairo_image_surface
+      set_source(surface, x, y)
+      # The source pattern holds its own reference, so the copy is freed with it rather than on GC
+      surface.destroy
     end
   end
 
@@ -52,5 +55,11 @@ module Cairo
     def to_gdk_pixbuf
       GdkPixbufCairo.surface_to_pixbuf(self)
     end
+
+    # Converts the pixels where they are and returns a pixbuf sharing them, without
+    # allocating a second buffer. The surface must not be used afterwards.
+    def to_gdk_pixbuf!
+      GdkPixbufCairo.surface_to_pixbuf!(self)
+    end
   end
 end
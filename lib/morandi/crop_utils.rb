@@ -1,6 +1,7 @@
 # frozen_string_literal: true
 
 require 'gdk_pixbuf2'
+require 'morandi_native'
 
 module Morandi
   # Utility functions relating to cropping
@@ -42,56 +43,42 @@ module Morandi
     end
 
     def apply_crop(pixbuf, x_coord, y_coord, width, height, fill_col = 0xffffffff)
-      if x_coord.negative? ||
-         y_coord.negative? ||
-         ((x_coord + width) > pixbuf.width) ||
-         ((y_coord + height) > pixbuf.height)
-
-        base_pixbuf = GdkPixbuf::Pixbuf.new(
-          colorspace: GdkPixbuf::Colorspace::RGB,
-          has_alpha: false,
-          bits_per_sample: 8,
-          width: width,
-          height: height
-        )
-        base_pixbuf.fill!(fill_col)
-
-        offset_x = [x_coord, 0].max
-        offset_y = [y_coord, 0].max
-        copy_w = [width, pixbuf.width - offset_x].min
-        copy_h = [height, pixbuf.height - offset_y].min
-
-        paste_x = [x_coord, 0].min * -1
-        paste_y = [y_coord, 0].min * -1
-
-        copy_w = base_pixbuf.width - paste_x if copy_w + paste_x > base_pixbuf.width
-        copy_h = base_pixbuf.height - paste_y if copy_h + paste_y > base_pixbuf.height
-
-        base_pixbuf.composite!(
-          pixbuf,
-          dest_x: paste_x,
-          dest_y: paste_y,
-          dest_width: copy_w,
-          dest_height: copy_h,
-          offset_x: paste_x - offset_x,
-          offset_y: paste_y - offset_y,
-          scale_x: 1,
-          scale_y: 1,
-          interpolation_type: :hyper,
-          overall_alpha: 255
-        )
-        pixbuf = base_pixbuf
+      if outside?(pixbuf.width, pixbuf.height, x_coord, y_coord, width, height)
+        # Copies the rows that overlap the image and fills the rest, blending any alpha over the fill
+        pixbuf = MorandiNative::PixbufUtils.crop_fill(pixbuf, x_coord, y_coord, width, height, fill_col)
       else
-        x_coord = x_coord.clamp(0, pixbuf.width)
-        y_coord = y_coord.clamp(0, pixbuf.height)
-        width = width.clamp(1, pixbuf.width - x_coord)
-        height = height.clamp(1, pixbuf.height - y_coord)
-
-        pixbuf = pixbuf.subpixbuf(x_coord, y_coord, width, height)
+        pixbuf = pixbuf.subpixbuf(*clamp_crop(pixbuf.width, pixbuf.height, x_coord, y_coord, width, height))
       end
       pixbuf
     end
 
+    # Whether a crop reaches past the edges of an image of the given size
+    def outside?(image_width, image_height, x_coord, y_coord, width, height)
+      x_coord.negative? ||
+        y_coord.negative? ||
+        ((x_coord + width) > image_width) ||
+        ((y_coord + height) > image_height)
+    end
+
+    # A crop within the image, limited to at least one pixel each way
+    def clamp_crop(image_width, image_height, x_coord, y_coord, width, height)
+      x_coord = x_coord.clamp(0, image_width)
+      y_coord = y_coord.clamp(0, image_height)
+      width = width.clamp(1, image_width - x_coord)
+      height = height.clamp(1, image_height - y_coord)
+      [x_coord, y_coord, width, height]
+    end
+
+    # The crop of an image that becomes the given crop once the image is rotated clockwise by angle, a multiple of 90
+    def unrotate_crop(image_width, image_height, angle, x_coord, y_coord, width, height)
+      case angle
+      when 90 then [y_coord, image_height - x_coord - width, height, width]
+      when 180 then [image_width - x_coord - width, image_height - y_coord - height, width, height]
+      when 270 then [image_width - y_coord - height, x_coord, height, width]
+      else [x_coord, y_coord, width, height]
+      end
+    end
+
     def apply_crop_vips(img, x_coord, y_coord, width, height)
       if x_coord.negative? ||
          y_coord.negative? ||
@@ -22,8 +22,9 @@ module Morandi
 
       yield(cr)
 
-      final_pb = surface.to_gdk_pixbuf
       cr.destroy
+      # The pixbuf takes over the surface's buffer, which lives until the pixbuf is freed
+      final_pb = surface.to_gdk_pixbuf!
       surface.destroy
       final_pb
     end
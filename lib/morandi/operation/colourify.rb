@@ -10,16 +10,23 @@ module Morandi
     class Colourify < ImageOperation
       attr_reader :filter
 
+      # Red, green and blue shifts of the tinting filters
+      TINTS = {
+        'greyscale' => [0, 0, 0],
+        'sepia' => [25, 5, -25],
+        'bluetone' => [-10, 5, 25]
+      }.freeze
+
       def alpha
         @alpha || 255
       end
 
       def sepia(pixbuf)
-        MorandiNative::PixbufUtils.tint(pixbuf, 25, 5, -25, alpha)
+        tint(pixbuf, *TINTS['sepia'])
       end
 
       def bluetone(pixbuf)
-        MorandiNative::PixbufUtils.tint(pixbuf, -10, 5, 25, alpha)
+        tint(pixbuf, *TINTS['bluetone'])
       end
 
       def null(pixbuf)
@@ -29,7 +36,7 @@ module Morandi
       alias colour null # WebKiosk
 
       def greyscale(pixbuf)
-        MorandiNative::PixbufUtils.tint(pixbuf, 0, 0, 0, alpha)
+        tint(pixbuf, *TINTS['greyscale'])
       end
       alias bw greyscale # WebKiosk
 
@@ -40,6 +47,12 @@ module Morandi
           pixbuf # Default is nothing
         end
       end
+
+      private
+
+      def tint(pixbuf, red, green, blue)
+        MorandiNative::PixbufUtils.tint(pixbuf, red, green, blue, alpha)
+      end
     end
   end
 end
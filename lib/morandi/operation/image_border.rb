@@ -11,90 +11,73 @@ module Morandi
     class ImageBorder < ImageOperation
       attr_accessor :style, :colour, :crop, :size, :print_size, :shrink, :border_size
 
+      # Border colours as 0xRRGGBBAA
+      COLOURS = {
+        'retro' => 0xffffccff,
+        'black' => 0x000000ff
+      }.freeze
+      WHITE = 0xffffffff
+
       def call(pixbuf)
-        return pixbuf unless %w[square retro].include? @style
+        args = border_args(pixbuf.width, pixbuf.height)
+        return pixbuf unless args
 
-        create_pixbuf_from_image_surface(:rgb24, pixbuf.width, pixbuf.height) do |cr|
-          if @crop && (@crop[0].negative? || @crop[1].negative?)
-            img_width = size[0]
-            img_height = size[1]
-          else
-            img_width = pixbuf.width
-            img_height = pixbuf.height
-          end
+        MorandiNative::PixbufUtils.border(pixbuf, *args)
+      end
 
-          @border_scale = [img_width, img_height].max.to_f / print_size.max.to_i
+      # Arguments to PixbufUtils.border after the pixbuf for an image of the given size, or nil without a border
+      def border_args(width, height)
+        return unless %w[square retro].include? @style
 
-          draw_background(cr, img_height, img_width)
+        if negative_crop?
+          img_width = size[0]
+          img_height = size[1]
+        else
+          img_width = width
+          img_height = height
+        end
 
-          x = border_width
-          y = border_width
+        @border_scale = [img_width, img_height].max.to_f / print_size.max.to_i
 
-          # This biggest impact will be on the smallest side, so to avoid white
-          # edges between photo and border scale by the longest changed side.
-          longest_side = [pixbuf.width, pixbuf.height].max.to_f
+        x = border_width
+        y = border_width
+        frame_x = 0
+        frame_y = 0
 
-          # Should be less than 1
-          pb_scale = (longest_side - (border_width * 2)) / longest_side
+        # This biggest impact will be on the smallest side, so to avoid white
+        # edges between photo and border scale by the longest changed side.
+        longest_side = [width, height].max.to_f
 
-          if @crop && (@crop[0].negative? || @crop[1].negative?)
-            x -= @crop[0]
-            y -= @crop[1]
-          end
+        # Should be less than 1
+        pb_scale = (longest_side - (border_width * 2)) / longest_side
 
-          draw_pixbuf(pixbuf, cr, img_height, img_width, pb_scale, x, y)
+        if negative_crop?
+          x -= @crop[0]
+          y -= @crop[1]
+          frame_x -= @crop[0]
+          frame_y -= @crop[1]
         end
-      end
 
-      private
+        origin, scale = @shrink ? [[border_width, border_width], pb_scale] : [[0, 0], 1.0]
+        radius = style == 'retro' ? border_width : 0
 
-      # Width is proportional to output size
-      def border_width
-        @border_size * @border_scale
+        # White background, the border colour over the image area and the photo clipped to
+        # a (rounded) rectangle inside it, drawn in a single pass
+        [COLOURS.fetch(colour, WHITE),
+         [frame_x, frame_y, img_width, img_height],
+         [x, y, img_width - (border_width * 2), img_height - (border_width * 2)],
+         radius, origin, scale]
       end
 
-      def draw_pixbuf(pixbuf, cr, img_height, img_width, pb_scale, x, y)
-        case style
-        when 'retro'
-          Morandi::CairoExt.rounded_rectangle(cr, x, y,
-                                              img_width + x - (border_width * 2),
-                                              img_height + y - (border_width * 2), border_width)
-        when 'square'
-          cr.rectangle(x, y, img_width - (border_width * 2), img_height - (border_width * 2))
-        end
-        cr.clip
-
-        if @shrink
-          cr.translate(border_width, border_width)
-          cr.scale(pb_scale, pb_scale)
-        end
-        cr.set_source_pixbuf(pixbuf)
-        cr.rectangle(0, 0, pixbuf.width, pixbuf.height)
+      private
 
-        cr.paint(1.0)
+      def negative_crop?
+        @crop && (@crop[0].negative? || @crop[1].negative?)
       end
 
-      def draw_background(cr, img_height, img_width)
-        cr.save do
-          cr.translate(-@crop[0], -@crop[1]) if @crop && (@crop[0].negative? || @crop[1].negative?)
-
-          cr.save do
-            cr.set_operator :source
-            cr.set_source_rgb 1, 1, 1
-            cr.paint
-
-            cr.rectangle(0, 0, img_width, img_height)
-            case colour
-            when 'retro'
-              cr.set_source_rgb 1, 1, 0.8
-            when 'black'
-              cr.set_source_rgb 0, 0, 0
-            else
-              cr.set_source_rgb 1, 1, 1
-            end
-            cr.fill
-          end
-        end
+      # Width is proportional to output size
+      def border_width
+        @border_size * @border_scale
       end
     end
   end
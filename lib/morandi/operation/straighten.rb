@@ -13,28 +13,8 @@ module Morandi
       def call(pixbuf)
         return pixbuf if angle.zero?
 
-        rotation_value_rad = angle * (Math::PI / 180)
-
-        ratio = pixbuf.width.to_f / pixbuf.height
-        rh = pixbuf.height / ((ratio * Math.sin(rotation_value_rad.abs)) + Math.cos(rotation_value_rad.abs))
-        scale = pixbuf.height / rh.to_f.abs
-
-        a_ratio = pixbuf.height.to_f / pixbuf.width
-        a_rh = pixbuf.width / ((a_ratio * Math.sin(rotation_value_rad.abs)) + Math.cos(rotation_value_rad.abs))
-        a_scale = pixbuf.width / a_rh.to_f.abs
-
-        scale = a_scale if a_scale > scale
-
-        create_pixbuf_from_image_surface(:rgb24, pixbuf.width, pixbuf.height) do |cr|
-          cr.translate(pixbuf.width / 2.0, pixbuf.height / 2.0)
-          cr.rotate(rotation_value_rad)
-          cr.scale(scale, scale)
-          cr.translate(pixbuf.width / -2.0, pixbuf.height / - 2.0)
-          cr.set_source_pixbuf(pixbuf)
-
-          cr.rectangle(0, 0, pixbuf.width, pixbuf.height)
-          cr.paint(1.0)
-        end
+        # Rotates about the centre, zooms so no corners show and flattens alpha onto black, as Cairo used to
+        MorandiNative::PixbufUtils.straighten(pixbuf, angle)
       end
     end
   end
@@ -0,0 +1,225 @@
+# frozen_string_literal: true
+
+require 'morandi_native'
+require 'morandi/crop_utils'
+require 'morandi/operation/colourify'
+require 'morandi/operation/image_border'
+
+module MorandiNative
+  # Plans everything ImageProcessor#process! does after red-eye correction - colour adjustments, sharpen/blur,
+  # rotation, straightening, cropping, colour filters and borders - as a list of native stages, then runs them in a
+  # single Pipeline.run call. The stages reuse a couple of working images between them rather than returning a new
+  # pixbuf to Ruby for each step, and adjacent point operations are applied in one pass.
+  # @!visibility private
+  class Pipeline
+    SHARPEN = [
+      -1, -1, -1, -1, -1,
+      -1,  2,  2,  2, -1,
+      -1,  2,  8,  2, -1,
+      -1,  2,  2,  2, -1,
+      -1, -1, -1, -1, -1
+    ].freeze
+
+    BLUR = [
+      0, 1, 1, 1, 0,
+      1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1,
+      0, 1, 1, 1, 0
+    ].freeze
+
+    DEFAULT_CONFIG = {
+      'border-size-mm' => 5
+    }.freeze
+
+    # Crops past the edge are filled with white
+    FILL = 0xffffffff
+
+    attr_reader :options
+
+    # scale is the size of the image being processed relative to the original, which crops are given against
+    def initialize(options, scale = 1.0)
+      @options = options
+      @scale = scale
+      @width = options['output.width']
+      @height = options['output.height']
+    end
+
+    # If pixbuf was decoded as just the source_region of an image of source_size, the stages skip cropping to it
+    def call(pixbuf, source_size: nil, region: nil)
+      stages = stages(*(source_size || [pixbuf.width, pixbuf.height]), region)
+      raise ArgumentError, "#{region} is not the region the pipeline starts from" if region && !region.eql?(@region)
+
+      self.class.run(pixbuf, stages)
+    end
+
+    # The [x, y, width, height] part of an image of the given size that the stages start by cropping to, if they do
+    def source_region(width, height)
+      stages(width, height)
+      @region
+    end
+
+    # The stages, each [name, *args], for an image of the given size, or for just its given region
+    def stages(width, height, loaded = nil)
+      @stages = []
+      @region = nil
+      @source_size = [width, height]
+      @loaded = loaded
+      # Clockwise, like the option
+      @angle = options['angle'].to_i % 360
+      # Borders are measured against the image before cropping
+      @image_size = @size = (@angle % 180) == 90 ? [height, width] : [width, height]
+
+      crop = crop_coords
+      unless crop && options['straighten'].to_f.zero? && plan_crop_first(crop)
+        @stages.push(*[colour_lut_stage, filter_stage].compact)
+        plan_rotate
+        plan_crop(crop)
+      end
+      plan_filters
+      plan_decorations
+
+      @stages
+    end
+
+    private
+
+    def config_for(key)
+      return options[key] if options&.key?(key)
+
+      DEFAULT_CONFIG[key]
+    end
+
+    def colour_lut_stage
+      brighten = (5 * options['brighten']).clamp(-100, 100) if options['brighten'].to_i.nonzero?
+      gamma = options['gamma'] if options['gamma'] && not_equal_to_one?(options['gamma'])
+      contrast = (5 * options['contrast']).clamp(-100, 100) if options['contrast'].to_i.nonzero?
+
+      # Brightness, gamma and contrast in that order, composed into a single table
+      [:colour_lut, brighten || 0, gamma, contrast || 0] if brighten || gamma || contrast
+    end
+
+    def filter_stage
+      return unless options['sharpen'].to_i.nonzero?
+
+      if options['sharpen'].positive?
+        [:filter, SHARPEN, SHARPEN.inject(0, &:+), [options['sharpen'], 5].min]
+      elsif options['sharpen'].negative?
+        [:filter, BLUR, BLUR.inject(0, &:+), [(options['sharpen'] * -1), 5].min]
+      end
+    end
+
+    def plan_rotate
+      @stages << [:rotate, @angle] unless @angle.zero?
+      @stages << [:straighten, options['straighten'].to_f] unless options['straighten'].to_f.zero?
+    end
+
+    # The crop of the rotated and straightened image, if there is one
+    def crop_coords
+      crop = options['crop']
+
+      return if crop.nil? && config_for('image.auto-crop').eql?(false)
+
+      crop = crop.split(',').map(&:to_i) if crop.is_a?(String) && crop =~ /^\d+,\d+,\d+,\d+/
+
+      crop = nil unless crop.is_a?(Array) && crop.size.eql?(4) && crop.all? do |i|
+        i.is_a?(Numeric)
+      end
+
+      # can't crop, won't crop
+      return if @width.nil? && @height.nil? && crop.nil?
+
+      crop = crop.map { |s| (s.to_f * @scale).floor } if crop && not_equal_to_one?(@scale)
+
+      crop ||= Morandi::CropUtils.autocrop_coords(@size[0], @size[1], @width, @height)
+      return unless crop
+
+      Morandi::CropUtils.outside?(*@size, *crop) ? crop : Morandi::CropUtils.clamp_crop(*@size, *crop)
+    end
+
+    def plan_crop(crop)
+      return unless crop
+
+      @stages << [:crop, *crop, FILL]
+      @size = crop[2, 2]
+    end
+
+    # Colour adjustments work pixel by pixel and sharpen/blur only look a few pixels around each one, so without
+    # straightening (which zooms to suit the whole image) they give the same result on just the part of the image
+    # that is kept, plus a halo for the filter. Right angle rotations only move that part, so it is cropped first.
+    # Returns false if nothing near the crop is in the image.
+    def plan_crop_first(crop)
+      lut = colour_lut_stage
+      filter = filter_stage
+      source = Morandi::CropUtils.unrotate_crop(*@source_size, @angle, *crop)
+      region = crop_region(source, filter ? (Math.sqrt(filter[1].size).to_i / 2) * filter[3] : 0)
+      return false unless region
+
+      # The crop within the region; only colour adjustments have to come before filling past the edge
+      trim = [source[0] - region[0], source[1] - region[1], *source[2, 2]]
+      lut_first = filter || Morandi::CropUtils.outside?(*region[2, 2], *trim)
+
+      @region = region unless region.eql?([0, 0, *@source_size])
+      @stages << [:crop, *region, FILL] unless loaded_region?(region)
+      @stages << lut if lut && lut_first
+      @stages << filter if filter
+      @stages << [:crop, *trim, FILL] unless trim.eql?([0, 0, *region[2, 2]])
+      @stages << [:rotate, @angle] unless @angle.zero?
+      # Next to the tint, if there is one, so both are applied in one pass
+      @stages << lut if lut && !lut_first
+      @size = crop[2, 2]
+
+      true
+    end
+
+    def loaded_region?(region)
+      region.eql?(@loaded || [0, 0, *@source_size])
+    end
+
+    # The part of the source image within halo pixels of a crop of it, or nil if there is none
+    def crop_region(crop, halo)
+      x0 = (crop[0] - halo).clamp(0, @source_size[0])
+      y0 = (crop[1] - halo).clamp(0, @source_size[1])
+      x1 = (crop[0] + crop[2] + halo).clamp(0, @source_size[0])
+      y1 = (crop[1] + crop[3] + halo).clamp(0, @source_size[1])
+
+      [x0, y0, x1 - x0, y1 - y0] if x1 > x0 && y1 > y0
+    end
+
+    def plan_filters
+      tint = Morandi::Operation::Colourify::TINTS[options['fx']]
+
+      @stages << [:tint, *tint, 255] if tint
+    end
+
+    def plan_decorations
+      style = options['border-style']
+      colour = options['background-style']
+
+      return if style.nil? || style.eql?('none')
+      return if colour.eql?('none')
+
+      colour ||= 'black'
+
+      crop = options['crop']
+      crop = crop.map { |s| (s.to_f * @scale).floor } if crop && not_equal_to_one?(@scale)
+
+      op = Morandi::Operation::ImageBorder.new_from_hash(
+        'style' => style,
+        'colour' => colour || '#000000',
+        'crop' => crop,
+        'size' => @image_size,
+        'print_size' => [@width, @height],
+        'shrink' => true,
+        'border_size' => @scale * config_for('border-size-mm').to_i * 300 / 25.4 # 5mm at 300dpi
+      )
+
+      args = op.border_args(*@size)
+      @stages << [:border, *args] if args
+    end
+
+    def not_equal_to_one?(float)
+      (float - 1.0).abs >= Float::EPSILON
+    end
+  end
+end
@@ -1,26 +1,45 @@
 # frozen_string_literal: true
 
 require 'gdk_pixbuf2'
+require 'morandi_native'
 require 'morandi/srgb_conversion'
 
 module Morandi
   # ProfiledPixbuf is a descendent of GdkPixbuf::Pixbuf with ICC support.
-  # It attempts to load an image using jpegicc/littlecms to ensure that it is sRGB.
+  # Images with an embedded RGB colour profile are converted to sRGB with littlecms once they are decoded; jpgicc is
+  # only run for other profiles (e.g. CMYK), which have to be applied before gdk-pixbuf turns the image into RGB.
   # NOTE: pixbuf supports colour profiles, but it requires an explicit icc-profile option to embed it when saving file
   class ProfiledPixbuf < GdkPixbuf::Pixbuf
     def initialize(path, _local_options, max_size_px = nil)
-      srgb_converted_file_path = srgb_path(path)
+      profile = Morandi::SrgbConversion.embedded_profile(path) if Morandi::SrgbConversion.valid_jpeg?(path)
+      srgb_converted_file_path = srgb_path(path) if profile && !Morandi::SrgbConversion.rgb_profile?(profile)
       path = srgb_converted_file_path || path
 
+      # Loading at a size lets the JPEG loader decode at 1/2, 1/4 or 1/8 scale before its final resize
       if max_size_px
         super(file: path, width: max_size_px, height: max_size_px)
       else
         super(file: path)
       end
+
+      MorandiNative::PixbufUtils.icc_to_srgb!(self, profile) if profile && srgb_converted_file_path.nil?
     ensure
       FileUtils.rm_f(srgb_converted_file_path) if srgb_converted_file_path
     end
 
+    # Decodes just the [x, y, width, height] part of a JPEG, converted to sRGB like a whole image would be; nil when
+    # it has to be loaded whole, e.g. as it is not a JPEG, jpgicc is needed for its profile or libjpeg cannot skip
+    def self.region(path, region)
+      return unless MorandiNative::PixbufUtils::JPEG_REGIONS && Morandi::SrgbConversion.valid_jpeg?(path)
+
+      profile = Morandi::SrgbConversion.embedded_profile(path)
+      return if profile && !Morandi::SrgbConversion.rgb_profile?(profile)
+
+      pixbuf = MorandiNative::PixbufUtils.load_jpeg_region(path, *region)
+      MorandiNative::PixbufUtils.icc_to_srgb!(pixbuf, profile) if pixbuf && profile
+      pixbuf
+    end
+
     private
 
     def srgb_path(original_path)
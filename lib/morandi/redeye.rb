@@ -1,40 +1,44 @@
 # frozen_string_literal: true
 
+require 'morandi_native'
+
 module Morandi
   module RedEye
     # The parameter determines how many reddish pixels needs to be in the area to consider it a valid red eye
     # The reason for its existence is to prevent the situations when the bigger red area causes an excessive correction
     # e.g. continuous red eyeglasses frame or sunburnt person's skin around eyes forming an area
-    RED_AREA_DENSITY_THRESHOLD = 0.3
+    # It is also the default min_density of MorandiNative::RedEye#find_blobs and .correct_taps
+    RED_AREA_DENSITY_THRESHOLD = MorandiNative::RedEye::RED_AREA_DENSITY_THRESHOLD
 
     # RedEye finder that looks for "eye" closest to a point
     module TapRedEye
+      # What counts as a red eye; see MorandiNative::RedEye.correct_taps
+      OPTIONS = {
+        green_sensitivity: 2,
+        min_pixels: 4,
+        min_ratio: 0.5,
+        min_density: RED_AREA_DENSITY_THRESHOLD
+      }.freeze
+
+      # Pixels of the image's longer side per pixel of proxy scale; eyes are expected to be at least that scale across
+      PROXY_PIXELS = 500
+      MAX_PROXY = 8
+
       module_function
 
       def tap_on(pixbuf, x_coord, y_coord)
-        n = ([pixbuf.height, pixbuf.width].max / 10)
-        x1  = [x_coord - n, 0].max
-        x2  = [x_coord + n, pixbuf.width].min
-        y1  = [y_coord - n, 0].max
-        y2  = [y_coord + n, pixbuf.height].min
-
-        return pixbuf unless (x1 >= 0) && (x2 > x1) && (y1 >= 0) && (y2 > y1)
-
-        red_eye = MorandiNative::RedEye.new(pixbuf, x1, y1, x2, y2)
-
-        sensitivity = 2
-        blobs = red_eye.identify_blobs(sensitivity).reject do |region|
-          region.noPixels < 4 || !region.squareish?(0.5, RED_AREA_DENSITY_THRESHOLD)
-        end
+        correct_taps(pixbuf, [[x_coord, y_coord]])
+      end
 
-        sorted_blobs = blobs.sort_by do |region|
-          region.area_min_x = x1
-          region.area_min_y = y1
-        end
+      # Corrects the eye found around each [x, y] point in place, searching areas that overlap together
+      def correct_taps(pixbuf, points)
+        MorandiNative::RedEye.correct_taps(pixbuf, points, OPTIONS.merge(proxy: proxy_scale(pixbuf)))
+      end
 
-        blob = sorted_blobs.last
-        red_eye.correct_blob(blob.id) if blob
-        red_eye.pixbuf
+      # Checks one pixel in every proxy x proxy cell for red before labelling around them, more sparsely the bigger
+      # the image; small images are labelled whole
+      def proxy_scale(pixbuf)
+        ([pixbuf.width, pixbuf.height].max / PROXY_PIXELS).clamp(1, MAX_PROXY)
       end
     end
   end
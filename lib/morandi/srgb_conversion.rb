@@ -5,6 +5,9 @@ require 'gdk_pixbuf2'
 module Morandi
   # Converts the file under `path` to sRGB colour space
   class SrgbConversion
+    JPEG_START = "\xff\xd8".b.freeze
+    ICC_MARKER = "ICC_PROFILE\0".b.freeze
+
     # Performs a conversion to srgb colour space if possible
     # Returns a path to converted file on success or nil on failure
     def self.perform(path)
@@ -21,6 +24,41 @@ module Morandi
       icc_file_path
     end
 
+    # The ICC profile embedded in a JPEG file, as the bytes of the profile, or nil if there is none.
+    # Large profiles are split over several APP2 segments, numbered from 1; only the headers before the image data are
+    # read.
+    def self.embedded_profile(path)
+      chunks = {}
+
+      File.open(path, 'rb') do |file|
+        return unless file.read(2).eql?(JPEG_START)
+
+        while (chunk = next_icc_chunk(file))
+          chunks[chunk.getbyte(ICC_MARKER.size)] = chunk.byteslice((ICC_MARKER.size + 2)..)
+        end
+      end
+
+      chunks.sort.map(&:last).join unless chunks.empty?
+    end
+
+    # Profiles for CMYK or grey data can't be applied to the RGB pixels gdk-pixbuf decodes
+    def self.rgb_profile?(profile)
+      profile.byteslice(16, 4).eql?('RGB ')
+    end
+
+    # Reads segments up to the next APP2 holding part of an ICC profile, returning its data, or nil at the image data
+    def self.next_icc_chunk(file)
+      loop do
+        marker, type, length = file.read(4)&.unpack('CCn')
+        return if marker != 0xff || length.nil? || length < 2 || [0xd9, 0xda].include?(type)
+
+        data = file.read(length - 2)
+        return if data.nil?
+        return data if type.eql?(0xe2) && data.start_with?(ICC_MARKER) && data.bytesize > ICC_MARKER.size + 2
+      end
+    end
+    private_class_method :next_icc_chunk
+
     def self.default_icc_path(path)
       "#{path}.icc.jpg"
     end
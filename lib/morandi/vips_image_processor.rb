@@ -17,6 +17,8 @@ module Morandi
       'bluetone' => BLUETONE_MODIFIER
     }.freeze
     SUPPORTED_FILTERS = COLOUR_FILTER_MODIFIERS.keys + ['greyscale']
+    # Factors libjpeg can shrink by while decoding, by scaling the DCT, largest first
+    JPEG_SHRINK_FACTORS = [8, 4, 2].freeze
 
     def self.supports?(input, options)
       return false unless input.is_a?(String)
@@ -55,20 +57,12 @@ module Morandi
     end
 
     def process!
-      source_file_path = @path
-      begin
-        @img = Vips::Image.new_from_file(source_file_path)
-      rescue Vips::Error => e
-        # Match the known errors
-        raise UnknownTypeError if /is not a known file format/.match?(e.message)
-        raise CorruptImageError if /Premature end of JPEG file/.match?(e.message)
-
-        # Re-raise generic Error when unknown
-        raise Error, e.message
-      end
+      @img = load_image
       if @size_limit_on_load_px
         @scale = @size_limit_on_load_px.to_f / [@img.width, @img.height].max
-        @img = @img.resize(@scale) if not_equal_to_one?(@scale)
+        shrink_on_load!
+        residual_scale = @size_limit_on_load_px.to_f / [@img.width, @img.height].max
+        @img = @img.resize(residual_scale) if not_equal_to_one?(residual_scale)
       else
         @scale = 1.0
       end
@@ -103,6 +97,27 @@ module Morandi
 
     private
 
+    def load_image(**options)
+      Vips::Image.new_from_file(@path, **options)
+    rescue Vips::Error => e
+      # Match the known errors
+      raise UnknownTypeError if /is not a known file format/.match?(e.message)
+      raise CorruptImageError if /Premature end of JPEG file/.match?(e.message)
+
+      # Re-raise generic Error when unknown
+      raise Error, e.message
+    end
+
+    # Reopens a JPEG to decode it at 1/2, 1/4 or 1/8 size, so large photos are not decoded in full only to be shrunk.
+    # Like vips' own thumbnailing, at least a factor of two is left to the resize, as the DCT shrink alone is sharper.
+    def shrink_on_load!
+      return unless Morandi::SrgbConversion.valid_jpeg?(@path)
+
+      original_max = [@img.width, @img.height].max
+      shrink = JPEG_SHRINK_FACTORS.find { |factor| original_max >= factor * 2 * @size_limit_on_load_px }
+      @img = load_image(shrink: shrink) if shrink
+    end
+
     # Remove the alpha channel if present. Vips supports alpha, but the current Pixbuf processor happens to strip it in
     # most cases (straighten and cropping beyond image bounds are exceptions)
     #
@@ -35,5 +35,103 @@ RSpec.describe GdkPixbufCairo do
       expect(pixbuf.n_channels).to eq 3
       expect(pixbuf.pixels).to eq([255, 255, 255] * (4**2))
     end
+
+    it 'should convert fully transparent pixels to transparent black' do
+      pb = GdkPixbuf::Pixbuf.new(colorspace: GdkPixbuf::Colorspace::RGB,
+                                 has_alpha: true,
+                                 bits_per_sample: 8,
+                                 width: 4,
+                                 height: 4)
+      pb.fill!(0x20406000)
+
+      pixbuf = pb.to_cairo_image_surface.to_gdk_pixbuf
+      expect(pixbuf.pixels).to eq([0, 0, 0, 0] * (4**2))
+    end
+
+    it 'should premultiply and un-premultiply every alpha level like the per-byte conversion did' do
+      pixels = (0..255).flat_map { |alpha| [(alpha * 7) % 256, 255 - alpha, 200, alpha] }
+      data = pixels.pack('C*')
+      pb = GdkPixbuf::Pixbuf.new(data: data,
+                                 colorspace: GdkPixbuf::Colorspace::RGB,
+                                 has_alpha: true,
+                                 bits_per_sample: 8,
+                                 width: 256,
+                                 height: 1)
+
+      premultiply = lambda do |c, a|
+        t = (c * a) + 0x80
+        ((t >> 8) + t) >> 8
+      end
+      expected_surface = pixels.each_slice(4).flat_map do |r, g, b, a|
+        [premultiply.call(b, a), premultiply.call(g, a), premultiply.call(r, a), a]
+      end
+      surface = pb.to_cairo_image_surface
+      expect(surface.data.unpack('C*')).to eq(expected_surface)
+
+      expected_pixbuf = expected_surface.each_slice(4).flat_map do |b, g, r, a|
+        a.zero? ? [0, 0, 0, 0] : [r * 255 / a, g * 255 / a, b * 255 / a, a]
+      end
+      expect(surface.to_gdk_pixbuf.pixels).to eq(expected_pixbuf)
+    end
+  end
+
+  context '#surface_to_pixbuf!' do
+    %i[argb32 rgb24].each do |format|
+      it "should convert a #{format} surface where it is, giving the same pixels as #surface_to_pixbuf" do
+        surface = Cairo::ImageSurface.new(format, 13, 7)
+        Cairo::Context.new(surface).tap do |cr|
+          cr.set_source_rgba(0.9, 0.4, 0.1, 0.6)
+          cr.paint
+          cr.set_source_rgb(0.2, 0.7, 0.3)
+          cr.rectangle(2, 1, 5, 4)
+          cr.fill
+        end
+        expected = surface.to_gdk_pixbuf
+
+        pixbuf = surface.to_gdk_pixbuf!
+        surface.destroy
+        GC.start
+
+        expect([pixbuf.width, pixbuf.height, pixbuf.n_channels])
+          .to eq([expected.width, expected.height, expected.n_channels])
+        expect(pixbuf.save_to_buffer('png')).to eq(expected.save_to_buffer('png'))
+      end
+    end
+  end
+
+  context '.concurrency' do
+    around do |example|
+      original = described_class.concurrency
+      example.run
+    ensure
+      described_class.concurrency = original
+    end
+
+    it 'should be separate from MorandiNative.concurrency' do
+      native = MorandiNative.concurrency
+      described_class.concurrency = native + 1
+
+      expect(described_class.concurrency).to eq(native + 1)
+      expect(MorandiNative.concurrency).to eq(native)
+    end
+
+    it 'should convert large images the same way in bands as on one thread' do
+      pb = GdkPixbuf::Pixbuf.new(colorspace: GdkPixbuf::Colorspace::RGB,
+                                 has_alpha: true,
+                                 bits_per_sample: 8,
+                                 width: 1024,
+                                 height: 1024)
+      pb.fill!(0x80402099)
+
+      described_class.concurrency = 1
+      expected = pb.to_cairo_image_surface.to_gdk_pixbuf.pixels
+
+      described_class.concurrency = 4
+      expect(pb.to_cairo_image_surface.to_gdk_pixbuf.pixels).to eq(expected)
+    end
+
+    it 'should reject a concurrency below one' do
+      expect { described_class.concurrency = 0 }.to raise_error(ArgumentError)
+    end
   end
 end
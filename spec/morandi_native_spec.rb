@@ -1,3 +1,781 @@
 # frozen_string_literal: true
 
 require_relative 'spec_helper'
+
+RSpec.describe MorandiNative::PixbufUtils do
+  let(:pixbuf) { GdkPixbuf::Pixbuf.new(file: 'spec/fixtures/match-with-transparency.png') }
+
+  def channel_differences(a, b)
+    row_bytes = a.width * a.n_channels
+    a_pixels = a.pixels
+    b_pixels = b.pixels
+    a.height.times.flat_map do |y|
+      a_pixels[y * a.rowstride, row_bytes].zip(b_pixels[y * b.rowstride, row_bytes]).map { |p, q| (p - q).abs }
+    end
+  end
+
+  context '.filter' do
+    let(:matrix) { MorandiNative::Pipeline::SHARPEN }
+    let(:divisor) { matrix.inject(0, &:+) }
+
+    it 'should match repeated single passes when given a number of iterations' do
+      expected = 3.times.inject(pixbuf) { |pb, _| described_class.filter(pb, matrix, divisor) }
+
+      filtered = described_class.filter(pixbuf, matrix, divisor, 3)
+      expect(filtered).not_to eq pixbuf
+      expect(filtered.pixels).to eq(expected.pixels)
+    end
+
+    it 'should reject a matrix without a centre tap' do
+      expect { described_class.filter(pixbuf, [1] * 16, 16) }.to raise_error(ArgumentError)
+    end
+
+    it 'should reject a non-positive number of iterations' do
+      expect { described_class.filter(pixbuf, matrix, divisor, 0) }.to raise_error(ArgumentError)
+    end
+
+    it 'should give the same result when run from several threads at once' do
+      expected = described_class.filter(pixbuf, matrix, divisor, 2).pixels
+
+      results = Array.new(4) { Thread.new { described_class.filter(pixbuf, matrix, divisor, 2).pixels } }.map(&:value)
+      expect(results).to all(eq(expected))
+    end
+  end
+
+  context '.rotate' do
+    let(:opaque_pixbuf) { GdkPixbuf::Pixbuf.new(file: 'spec/fixtures/public-domain-redeye-image-from-wikipedia.jpg') }
+
+    # GdkPixbuf#rotate turns anticlockwise
+    [[90, 270], [180, 180], [270, 90]].each do |clockwise, anticlockwise|
+      it "should match GdkPixbuf#rotate when turning #{clockwise} degrees" do
+        [pixbuf, opaque_pixbuf].each do |pb|
+          expect(described_class.rotate(pb, clockwise).pixels).to eq(pb.rotate(anticlockwise).pixels)
+        end
+      end
+    end
+
+    it 'should reject angles that are not a multiple of 90' do
+      expect { described_class.rotate(pixbuf, 45) }.to raise_error(ArgumentError)
+    end
+  end
+
+  context '.straighten' do
+    let(:opaque_pixbuf) { GdkPixbuf::Pixbuf.new(file: 'spec/fixtures/public-domain-redeye-image-from-wikipedia.jpg') }
+
+    # What Morandi::Operation::Straighten drew with Cairo before going native
+    def cairo_straighten(pixbuf, angle)
+      rad = angle * (Math::PI / 180)
+      width = pixbuf.width.to_f
+      height = pixbuf.height.to_f
+      scale = [height / (height / ((width / height * Math.sin(rad.abs)) + Math.cos(rad.abs))),
+               width / (width / ((height / width * Math.sin(rad.abs)) + Math.cos(rad.abs)))].max
+
+      surface = Cairo::ImageSurface.new(:rgb24, pixbuf.width, pixbuf.height)
+      cr = Cairo::Context.new(surface)
+      cr.translate(pixbuf.width / 2.0, pixbuf.height / 2.0)
+      cr.rotate(rad)
+      cr.scale(scale, scale)
+      cr.translate(pixbuf.width / -2.0, pixbuf.height / -2.0)
+      cr.set_source_pixbuf(pixbuf)
+      cr.rectangle(0, 0, pixbuf.width, pixbuf.height)
+      cr.paint(1.0)
+      surface.to_gdk_pixbuf
+    end
+
+    [5, -20, 2.5].each do |angle|
+      it "should match the Cairo rendering when turning #{angle} degrees" do
+        [pixbuf, opaque_pixbuf].each do |pb|
+          straightened = described_class.straighten(pb, angle)
+          expected = cairo_straighten(pb, angle)
+
+          expect([straightened.width, straightened.height, straightened.n_channels])
+            .to eq([expected.width, expected.height, expected.n_channels])
+
+          # Both sample bilinearly with 8 bit weights, but round positions slightly differently
+          differences = channel_differences(straightened, expected)
+          expect(differences.sum.to_f / differences.size).to be < 1
+          expect(differences.max).to be <= 8
+        end
+      end
+    end
+  end
+
+  context '.crop_fill' do
+    let(:source) { pixbuf.subpixbuf(300, 400, 20, 10) }
+    let(:fill) { [0x33, 0x66, 0x99] }
+
+    def pixel(pb, x, y)
+      pb.pixels[(y * pb.rowstride) + (x * pb.n_channels), pb.n_channels]
+    end
+
+    it 'should blend the overlap over the fill and fill the margins' do
+      cropped = described_class.crop_fill(source, -3, -2, 30, 16, 0x336699ff)
+
+      expect([cropped.width, cropped.height, cropped.n_channels]).to eq([30, 16, 3])
+      16.times do |y|
+        30.times do |x|
+          sx = x - 3
+          sy = y - 2
+          expected = if sx.between?(0, source.width - 1) && sy.between?(0, source.height - 1)
+                       *rgb, alpha = pixel(source, sx, sy)
+                       rgb.zip(fill).map { |c, f| ((alpha * c) + ((255 - alpha) * f)) / 255 }
+                     else
+                       fill
+                     end
+          expect(pixel(cropped, x, y)).to eq(expected), "pixel #{x},#{y}"
+        end
+      end
+    end
+
+    it 'should fill a crop that misses the image entirely' do
+      cropped = described_class.crop_fill(source, 50, 50, 4, 4, 0x336699ff)
+      expect(4.times.flat_map { |y| 4.times.map { |x| pixel(cropped, x, y) } }).to all(eq(fill))
+    end
+
+    it 'should reject an empty crop' do
+      expect { described_class.crop_fill(source, -1, -1, 0, 5) }.to raise_error(ArgumentError)
+    end
+  end
+
+  context '.border' do
+    let(:opaque_pixbuf) { GdkPixbuf::Pixbuf.new(file: 'spec/fixtures/public-domain-redeye-image-from-wikipedia.jpg') }
+
+    # What Morandi::Operation::ImageBorder drew with Cairo before going native
+    def cairo_border(pixbuf, colour, clip, radius, origin, scale)
+      surface = Cairo::ImageSurface.new(:rgb24, pixbuf.width, pixbuf.height)
+      cr = Cairo::Context.new(surface)
+      cr.set_source_rgb(*colour.map { |c| c / 255.0 })
+      cr.paint
+      x, y, width, height = clip
+      Morandi::CairoExt.rounded_rectangle(cr, x, y, x + width, y + height, radius)
+      cr.clip
+      cr.translate(*origin)
+      cr.scale(scale, scale)
+      cr.set_source_pixbuf(pixbuf)
+      cr.paint(1.0)
+      surface.to_gdk_pixbuf
+    end
+
+    [['square', 0], ['retro', 23.6]].each do |style, radius|
+      it "should match the Cairo rendering of a #{style} border" do
+        [pixbuf, opaque_pixbuf].each do |pb|
+          border = 11.8
+          clip = [border, border, pb.width - (border * 2), pb.height - (border * 2)]
+          scale = ([pb.width, pb.height].max - (border * 2)) / [pb.width, pb.height].max
+          colour = [0xff, 0xff, 0xcc]
+
+          bordered = described_class.border(pb, 0xffffccff, [0, 0, pb.width, pb.height], clip, radius,
+                                            [border, border], scale)
+          expected = cairo_border(pb, colour, clip, radius, [border, border], scale)
+
+          expect([bordered.width, bordered.height, bordered.n_channels])
+            .to eq([expected.width, expected.height, expected.n_channels])
+
+          # Cairo flattens the corner curves and rasterises them its own way, so edges differ slightly
+          differences = channel_differences(bordered, expected)
+          expect(differences.sum.to_f / differences.size).to be < 1
+          expect(differences.count { |d| d > 8 }).to be < (differences.size / 100)
+        end
+      end
+    end
+
+    it 'should leave white outside the frame' do
+      bordered = described_class.border(pixbuf, 0x000000ff, [4, 2, 10, 10], [6, 6, 4, 4], 0, [0, 0], 1)
+
+      pixels = bordered.pixels
+      expect(pixels[0, 3]).to eq([255, 255, 255])
+      expect(pixels[(2 * bordered.rowstride) + (4 * 3), 3]).to eq([0, 0, 0])
+    end
+
+    it 'should reject a malformed rectangle' do
+      expect { described_class.border(pixbuf, 0, [0, 0, 1], [0, 0, 1, 1], 0, [0, 0], 1) }
+        .to raise_error(ArgumentError)
+    end
+  end
+
+  context '.colour_lut' do
+    it 'should match brightness, gamma and contrast applied in turn' do
+      expected = described_class.contrast(described_class.gamma(described_class.brightness(pixbuf, 25), 1.3), -15)
+
+      expect(described_class.colour_lut(pixbuf, 25, 1.3, -15).pixels).to eq(expected.pixels)
+    end
+
+    it 'should skip gamma when it is nil' do
+      expected = described_class.contrast(described_class.brightness(pixbuf, -40), 35)
+
+      expect(described_class.colour_lut(pixbuf, -40, nil, 35).pixels).to eq(expected.pixels)
+    end
+  end
+
+  context '.icc_to_srgb!' do
+    let(:file_in) { 'spec/fixtures/pumpkins-icc-adobe-rgb-1998.jpg' }
+    let(:pixbuf) { GdkPixbuf::Pixbuf.new(file: file_in) }
+    let(:profile) { Morandi::SrgbConversion.embedded_profile(file_in) }
+
+    it 'should convert the pixels in place from an embedded profile' do
+      before = pixbuf.pixels
+
+      expect(described_class.icc_to_srgb!(pixbuf, profile)).to equal(pixbuf)
+      expect(pixbuf.pixels).not_to eq(before)
+    end
+
+    context 'with an sRGB profile' do
+      let(:file_in) { 'spec/fixtures/public-domain-redeye-image-from-wikipedia.jpg' }
+
+      it 'should leave the pixels alone' do
+        before = pixbuf.pixels
+
+        expect(described_class.icc_to_srgb!(pixbuf, profile)).to be_nil
+        expect(pixbuf.pixels).to eq(before)
+      end
+    end
+
+    it 'should stay within a level on average of the colours jpgicc gives' do
+      jpgicc_path = Morandi::SrgbConversion.perform(file_in)
+      expected = GdkPixbuf::Pixbuf.new(file: jpgicc_path)
+      described_class.icc_to_srgb!(pixbuf, profile)
+
+      # Most of the difference is the quality 97 re-encode of jpgicc's output
+      differences = channel_differences(pixbuf, expected)
+      expect(differences.sum / differences.size.to_f).to be <= 1
+    ensure
+      FileUtils.rm_f(jpgicc_path) if jpgicc_path
+    end
+
+    it 'should ignore profiles it cannot read' do
+      expect(described_class.icc_to_srgb!(pixbuf, 'not a profile')).to be_nil
+    end
+
+    it 'should reject an unknown rendering intent' do
+      expect { described_class.icc_to_srgb!(pixbuf, profile, 4) }.to raise_error(ArgumentError)
+    end
+
+    context 'with the transform cache' do
+      around do |example|
+        size = MorandiNative.icc_cache_size
+        lut_after = MorandiNative.icc_lut_after
+        MorandiNative.icc_cache_clear
+        example.run
+      ensure
+        MorandiNative.icc_cache_size = size
+        MorandiNative.icc_lut_after = lut_after
+        MorandiNative.icc_cache_clear
+      end
+
+      it 'should reuse the transform for the same profile' do
+        described_class.icc_to_srgb!(pixbuf, profile)
+        described_class.icc_to_srgb!(GdkPixbuf::Pixbuf.new(file: file_in), profile.dup)
+
+        expect(MorandiNative.icc_cache_stats).to eq(hits: 1, misses: 1, size: 1)
+      end
+
+      it 'should keep nothing when its size is zero' do
+        MorandiNative.icc_cache_size = 0
+        described_class.icc_to_srgb!(pixbuf, profile)
+
+        expect(MorandiNative.icc_cache_stats).to eq(hits: 0, misses: 1, size: 0)
+      end
+
+      it 'should convert within a level through a table for frequent profiles' do
+        direct = described_class.icc_to_srgb!(GdkPixbuf::Pixbuf.new(file: file_in), profile).pixels
+        MorandiNative.icc_lut_after = 1
+        sampled = described_class.icc_to_srgb!(pixbuf, profile).pixels
+
+        expect(sampled.zip(direct).map { |a, b| (a - b).abs }.max).to be <= 1
+      end
+
+      it 'should reject a negative size' do
+        expect { MorandiNative.icc_cache_size = -1 }.to raise_error(ArgumentError)
+      end
+    end
+  end
+
+  context 'argument checks' do
+    it 'should reject nil before starting work' do
+      expect { described_class.brightness(nil, 5) }.to raise_error(ArgumentError)
+      expect { described_class.rotate(nil, 90) }.to raise_error(ArgumentError)
+    end
+
+    it 'should reject a mask bigger than the image' do
+      mask = GdkPixbuf::Pixbuf.new(colorspace: GdkPixbuf::Colorspace::RGB, has_alpha: false, bits_per_sample: 8,
+                                   width: pixbuf.width + 1, height: 1)
+
+      expect { described_class.mask(pixbuf, mask) }.to raise_error(ArgumentError)
+    end
+  end
+
+  context '.load_jpeg_region' do
+    let(:file_in) { 'spec/fixtures/public-domain-redeye-image-from-wikipedia.jpg' }
+    let(:pixbuf) { GdkPixbuf::Pixbuf.new(file: file_in) }
+
+    it 'should decode the same pixels as the whole image has there' do
+      skip 'libjpeg cannot decode part of an image' unless described_class::JPEG_REGIONS
+
+      region = described_class.load_jpeg_region(file_in, 101, 57, 203, 150)
+      expected = described_class.crop_fill(pixbuf, 101, 57, 203, 150)
+
+      expect([region.width, region.height]).to eq([203, 150])
+      expect(channel_differences(region, expected).max).to eq(0)
+    end
+
+    it 'should give nil for regions outside the image and files it cannot decode' do
+      expect(described_class.load_jpeg_region(file_in, 0, 0, pixbuf.width + 1, 10)).to be_nil
+      expect(described_class.load_jpeg_region('spec/fixtures/match-with-transparency.png', 0, 0, 1, 1)).to be_nil
+    end
+  end
+
+  context 'in-place variants' do
+    {
+      brightness!: [25],
+      contrast!: [-30],
+      gamma!: [1.6],
+      tint!: [25, 5, -25, 200],
+      colour_lut!: [25, 1.6, -30]
+    }.each do |method, args|
+      it "#{method} should modify the pixbuf like #{method.to_s.chomp('!')} returns a copy" do
+        expected = described_class.public_send(method.to_s.chomp('!'), pixbuf, *args).pixels
+
+        expect(described_class.public_send(method, pixbuf, *args)).to equal(pixbuf)
+        expect(pixbuf.pixels).to eq(expected)
+      end
+    end
+  end
+
+  context 'with each SIMD level' do
+    around do |example|
+      original = MorandiNative.simd
+      example.run
+    ensure
+      MorandiNative.simd = original
+    end
+
+    let(:operations) do
+      {
+        brightness: ->(pb) { described_class.brightness(pb, 30) },
+        contrast: ->(pb) { described_class.contrast(pb, -20) },
+        gamma: ->(pb) { described_class.gamma(pb, 1.4) },
+        tint: ->(pb) { described_class.tint(pb, 40, 20, -10, 180) }
+      }
+    end
+
+    it 'should produce the same pixels as the scalar kernels' do
+      MorandiNative.simd = 'scalar'
+      expected = operations.transform_values { |op| op.call(pixbuf).pixels }
+
+      MorandiNative.simd_levels.each do |level|
+        MorandiNative.simd = level
+        operations.each do |name, op|
+          expect(op.call(pixbuf).pixels).to eq(expected[name]), "#{name} differs at #{level}"
+        end
+      end
+    end
+
+    it 'should reject an unknown level' do
+      expect { MorandiNative.simd = 'mmx' }.to raise_error(ArgumentError)
+    end
+  end
+
+  context 'with several threads per image' do
+    around do |example|
+      original = MorandiNative.concurrency
+      example.run
+    ensure
+      MorandiNative.concurrency = original
+    end
+
+    let(:operations) do
+      {
+        brightness: ->(pb) { described_class.brightness(pb, 30) },
+        tint: ->(pb) { described_class.tint(pb, 40, 20, -10, 180) },
+        filter: ->(pb) { described_class.filter(pb, MorandiNative::Pipeline::SHARPEN, 8, 2) },
+        rotate: ->(pb) { described_class.rotate(pb, 90) },
+        straighten: ->(pb) { described_class.straighten(pb, 3) },
+        border: ->(pb) { described_class.border(pb, 0x000000ff, [0, 0, 50, 50], [5, 5, 40, 40], 5, [5, 5], 0.8) }
+      }
+    end
+
+    it 'should produce the same pixels as a single thread' do
+      MorandiNative.concurrency = 1
+      expected = operations.transform_values { |op| op.call(pixbuf).pixels }
+
+      MorandiNative.concurrency = 4
+      operations.each do |name, op|
+        expect(op.call(pixbuf).pixels).to eq(expected[name]), "#{name} differs"
+      end
+    end
+
+    it 'should reject a concurrency below one' do
+      expect { MorandiNative.concurrency = 0 }.to raise_error(ArgumentError)
+    end
+  end
+end
+
+RSpec.describe MorandiNative::Pipeline do
+  let(:pixbuf) { GdkPixbuf::Pixbuf.new(file: 'spec/fixtures/match-with-transparency.png') }
+  let(:utils) { MorandiNative::PixbufUtils }
+
+  # Crops may be views into a wider image, so compare row by row
+  def rows(pixbuf)
+    pixels = pixbuf.pixels
+    pixbuf.height.times.map { |y| pixels[y * pixbuf.rowstride, pixbuf.width * pixbuf.n_channels] }
+  end
+
+  context '.run' do
+    it 'should match running each stage in turn' do
+      matrix = MorandiNative::Pipeline::SHARPEN
+      stages = [
+        [:colour_lut, 20, 1.2, -10],
+        [:filter, matrix, matrix.sum, 2],
+        [:rotate, 90],
+        [:crop, 2, 3, 40, 30, 0xffffffff],
+        [:tint, 40, 20, -10, 255],
+        [:border, 0x000000ff, [0, 0, 40, 30], [4, 4, 32, 22], 3, [4, 4], 0.8]
+      ]
+
+      expected = utils.colour_lut(pixbuf, 20, 1.2, -10)
+      expected = utils.filter(expected, matrix, matrix.sum, 2)
+      expected = utils.rotate(expected, 90)
+      expected = utils.crop_fill(expected, 2, 3, 40, 30, 0xffffffff)
+      expected = utils.tint(expected, 40, 20, -10, 255)
+      expected = utils.border(expected, 0x000000ff, [0, 0, 40, 30], [4, 4, 32, 22], 3, [4, 4], 0.8)
+
+      expect(rows(described_class.run(pixbuf, stages))).to eq(rows(expected))
+    end
+
+    it 'should fill around crops past the edge' do
+      expected = utils.crop_fill(utils.straighten(pixbuf, 2), -5, -5, pixbuf.width, pixbuf.height + 10, 0xffffffff)
+      result = described_class.run(pixbuf, [[:straighten, 2], [:crop, -5, -5, pixbuf.width, pixbuf.height + 10,
+                                                              0xffffffff]])
+
+      expect(rows(result)).to eq(rows(expected))
+    end
+
+    it 'should leave the source untouched' do
+      before = rows(pixbuf)
+      described_class.run(pixbuf, [[:colour_lut, 50, nil, 0], [:tint, 10, 10, 10, 255]])
+
+      expect(rows(pixbuf)).to eq(before)
+    end
+
+    it 'should reject unknown stages' do
+      expect { described_class.run(pixbuf, [[:sparkle]]) }.to raise_error(ArgumentError)
+    end
+
+    it 'should reject stages with the wrong arguments' do
+      expect { described_class.run(pixbuf, [[:rotate, 45]]) }.to raise_error(ArgumentError)
+      expect { described_class.run(pixbuf, [[:crop, 0, 0, 0, 10, 0]]) }.to raise_error(ArgumentError)
+    end
+  end
+
+  context '#stages' do
+    let(:options) { { 'brighten' => 5, 'sharpen' => 2, 'angle' => 90, 'crop' => [10, 5, 20, 15] } }
+
+    it 'should crop to the part of the image the filter needs before adjusting it' do
+      stages = described_class.new(options).stages(pixbuf.width, pixbuf.height)
+
+      expect(stages.first).to eq([:crop, 1, pixbuf.height - 34, 23, 28, described_class::FILL])
+      expect(stages.map(&:first)).to eq(%i[crop colour_lut filter crop rotate])
+    end
+
+    it 'should give the same image as adjusting before cropping' do
+      pipeline = described_class.new(options)
+      matrix = described_class::SHARPEN
+      expected = described_class.run(pixbuf, [[:colour_lut, 25, nil, 0], [:filter, matrix, matrix.sum, 2],
+                                              [:rotate, 90], [:crop, 10, 5, 20, 15, described_class::FILL]])
+
+      expect(rows(pipeline.call(pixbuf))).to eq(rows(expected))
+    end
+
+    it 'should give the region it starts by cropping to' do
+      expect(described_class.new(options).source_region(pixbuf.width, pixbuf.height))
+        .to eq([1, pixbuf.height - 34, 23, 28])
+      expect(described_class.new('angle' => 90).source_region(pixbuf.width, pixbuf.height)).to be_nil
+    end
+
+    it 'should give the same image from just that region' do
+      pipeline = described_class.new(options)
+      region = pipeline.source_region(pixbuf.width, pixbuf.height)
+      cropped = MorandiNative::PixbufUtils.crop_fill(pixbuf, *region)
+
+      expect(rows(pipeline.call(cropped, source_size: [pixbuf.width, pixbuf.height], region: region)))
+        .to eq(rows(pipeline.call(pixbuf)))
+    end
+
+    it 'should keep the original order when straightening' do
+      stages = described_class.new(options.merge('straighten' => 2)).stages(pixbuf.width, pixbuf.height)
+
+      expect(stages.map(&:first)).to eq(%i[colour_lut filter rotate straighten crop])
+    end
+  end
+end
+
+RSpec.describe MorandiNative::RedEye do
+  let(:pixbuf) { GdkPixbuf::Pixbuf.new(file: 'spec/fixtures/public-domain-redeye-image-from-wikipedia.jpg') }
+  let(:options) { Morandi::RedEye::TapRedEye::OPTIONS }
+
+  # The eye a single tap used to find, by labelling just its area
+  def correct_one(pixbuf, x, y)
+    n = [pixbuf.width, pixbuf.height].max / 10
+    red_eye = described_class.new(pixbuf, [x - n, 0].max, [y - n, 0].max, [x + n, pixbuf.width].min,
+                                  [y + n, pixbuf.height].min)
+    blob = red_eye.identify_blobs(2).reject do |region|
+      region.noPixels < 4 || !region.squareish?(0.5, options[:min_density])
+    end.last
+    red_eye.correct_blob(blob.id) if blob
+  end
+
+  # An image of the mask, given as rows of booleans: red where it is set and black elsewhere
+  def mask_pixbuf(mask)
+    data = mask.flatten.flat_map { |set| set ? [255, 0, 0, 255] : [0, 0, 0, 255] }.pack('C*')
+    GdkPixbuf::Pixbuf.new(data: data, colorspace: GdkPixbuf::Colorspace::RGB, has_alpha: true, bits_per_sample: 8,
+                          width: mask.first.size, height: mask.size)
+  end
+
+  def identified_blobs(mask)
+    red_eye = described_class.new(mask_pixbuf(mask), 0, 0, mask.first.size, mask.size)
+    red_eye.identify_blobs(2).map { |r| [r.id, r.minX, r.minY, r.maxX, r.maxY, r.width, r.height, r.noPixels] }
+  end
+
+  # The 8-connected regions of the mask, numbered in the raster order of their first pixel
+  def flood_fill_blobs(mask)
+    height = mask.size
+    width = mask.first.size
+    seen = Array.new(height) { Array.new(width, false) }
+    blobs = []
+    height.times do |y|
+      width.times do |x|
+        next if !mask[y][x] || seen[y][x]
+
+        seen[y][x] = true
+        stack = [[x, y]]
+        xs = []
+        ys = []
+        until stack.empty?
+          px, py = stack.pop
+          xs << px
+          ys << py
+          [px - 1, px, px + 1].product([py - 1, py, py + 1]).each do |nx, ny|
+            next if nx.negative? || ny.negative? || nx >= width || ny >= height || !mask[ny][nx] || seen[ny][nx]
+
+            seen[ny][nx] = true
+            stack << [nx, ny]
+          end
+        end
+        blobs << [blobs.size + 1, xs.min, ys.min, xs.max, ys.max, xs.max - xs.min + 1, ys.max - ys.min + 1, xs.size]
+      end
+    end
+    # identify_blobs leaves out single pixels
+    blobs.reject { |blob| blob.last < 2 }
+  end
+
+  context '#identify_blobs' do
+    masks = {
+      'random pixels' => Array.new(40) { |y| Array.new(60) { |x| ((x * 7919) + (y * 104_729)) % 11 < 5 } },
+      'a comb joined along its last row' => Array.new(20) { |y| Array.new(31) { |x| x.even? || y == 19 } },
+      'a serpentine' => Array.new(21) { |y| Array.new(30) { |x| y.even? || x == (y % 4 == 1 ? 29 : 0) } },
+      'diagonal lines and bars' => Array.new(24) do |y|
+        Array.new(24) { |x| ((x + y) % 7).zero? || (x % 6 == 3 && y.between?(2, 3)) }
+      end
+    }
+
+    masks.each do |name, mask|
+      it "should find the same blobs as a flood fill in #{name}" do
+        expected = flood_fill_blobs(mask)
+
+        expect(expected.size).to be > 0
+        expect(identified_blobs(mask)).to eq(expected)
+      end
+    end
+
+    it 'should widen the labels when a scan needs more than 65535 of them' do
+      # Pairs of pixels on every other row each take a new label; a bar along the last row joins the last of them
+      mask = Array.new(520) { |y| Array.new(780) { |x| y == 519 || (y.even? && x % 3 < 2) } }
+
+      blobs = identified_blobs(mask)
+      expect(blobs.size).to eq((259 * 260) + 1)
+      expect(blobs.first(2)).to eq([[1, 0, 0, 1, 0, 2, 1, 2], [2, 3, 0, 4, 0, 2, 1, 2]])
+      expect(blobs.last).to eq([blobs.size, 0, 518, 779, 519, 780, 2, 780 + (260 * 2)])
+      expect(blobs).to eq(flood_fill_blobs(mask))
+    end
+  end
+
+  context '#correct_blob' do
+    let(:width) { 24 }
+    let(:height) { 20 }
+    let(:in_blob) { ->(x, y) { ((x - 12)**2) + ((y - 10)**2) <= 20 } }
+    # A red disc on a greenish background, both varied so the feathered edge blends many different values
+    let(:pixels) do
+      height.times.flat_map do |y|
+        width.times.flat_map do |x|
+          if in_blob.call(x, y)
+            [200 + ((x + y) % 50), (x * y) % 60, (x + (3 * y)) % 90, 255]
+          else
+            [((x * 11) + (y * 7)) % 200, 150 + (((x * 3) + (y * 5)) % 100), ((x * 13) + (y * 3)) % 256, 255]
+          end
+        end
+      end
+    end
+    let(:red_eye) do
+      pb = GdkPixbuf::Pixbuf.new(data: pixels.pack('C*'), colorspace: GdkPixbuf::Colorspace::RGB, has_alpha: true,
+                                 bits_per_sample: 8, width: width, height: height)
+      described_class.new(pb, 0, 0, width, height)
+    end
+
+    # The per-pixel loop correct_blob used before feathering from a summed-area table, with alpha out of full
+    def per_pixel_correction(pixels, width, in_blob, full)
+      blob = (0...width).to_a.product((0...(pixels.size / 4 / width)).to_a).select { |x, y| in_blob.call(x, y) }
+      window = (-2..2).to_a.product((-2..2).to_a)
+      corrected = pixels.dup
+      ([blob.map(&:last).min - 1, 0].max...(pixels.size / 4 / width)).each do |y|
+        ([blob.map(&:first).min - 1, 0].max...width).each do |x|
+          alpha = in_blob.call(x, y) ? full : full * window.count { |dx, dy| in_blob.call(x + dx, y + dy) } / 25
+          next unless alpha.positive?
+
+          i = ((y * width) + x) * 4
+          r, g, b = pixels[i, 3]
+          grey = ((alpha * ((5 * r) + (60 * g) + (30 * b)) / 100) + ((1 - alpha) * r)).to_i
+          corrected[i, 3] = [r, g, b].map { |c| ((grey * alpha) + ((1 - alpha) * c)).clamp(0, 255).to_i }
+        end
+      end
+      corrected
+    end
+
+    it 'should desaturate the blob and its feathered edge as the per-pixel loop did' do
+      expect(red_eye.identify_blobs(2).map(&:id)).to eq([1])
+      red_eye.correct_blob(1)
+      corrected = red_eye.pixbuf.pixels
+
+      expect(corrected).not_to eq(pixels)
+      # Integer blending gives the exactly rounded down levels
+      expect(corrected).to eq(per_pixel_correction(pixels, width, in_blob, 1r))
+      # which floating point only missed where it rounded an exact value down a level
+      differences = corrected.zip(per_pixel_correction(pixels, width, in_blob, 1.0)).map { |a, b| a - b }
+      expect(differences).to all(be_between(0, 1))
+      expect(differences.count(1)).to be < (differences.size / 100)
+    end
+  end
+
+  context 'with a blob id outside the ones found' do
+    let(:mask) { Array.new(8) { |y| Array.new(8) { y.between?(2, 4) } } }
+    let(:red_eye) { described_class.new(mask_pixbuf(mask), 0, 0, 8, 8) }
+
+    it 'should raise IndexError' do
+      expect { red_eye.correct_blob(1) }.to raise_error(IndexError)
+
+      expect(red_eye.identify_blobs(2).map(&:id)).to eq([1])
+      expect { red_eye.correct_blob(0) }.to raise_error(IndexError)
+      expect { red_eye.correct_blob(-1) }.to raise_error(IndexError)
+      expect { red_eye.highlight_blob(2) }.to raise_error(IndexError)
+      expect { red_eye.preview_blob(2) }.to raise_error(IndexError)
+      expect { red_eye.correct_blob(1) }.not_to raise_error
+    end
+  end
+
+  context '#find_blobs' do
+    let(:red_eye) { described_class.new(pixbuf, 440, 550, 640, 750) }
+
+    it 'should return the eye-like blobs nearest the point, nearest first' do
+      centre = ->(r) { [440 + ((r.minX + r.maxX) / 2.0), 550 + ((r.minY + r.maxY) / 2.0)] }
+      expected = red_eye.identify_blobs(2).select do |region|
+        region.noPixels >= 4 && region.squareish?(0.5, options[:min_density])
+      end
+      expected = expected.reverse.sort_by.with_index do |region, i|
+        x, y = centre.call(region)
+        [((x - 540)**2) + ((y - 650)**2), i]
+      end
+
+      expect(red_eye.find_blobs(540, 650, options, 3).map(&:id)).to eq(expected.first(3).map(&:id))
+      expect(red_eye.find_blobs(540, 650, options).map(&:id)).to eq(expected.first(1).map(&:id))
+    end
+
+    it 'should reject a limit below one' do
+      expect { red_eye.find_blobs(540, 650, options, 0) }.to raise_error(ArgumentError)
+    end
+
+    it 'should default to the same density threshold as TapRedEye' do
+      # An X filling 9 of the 25 pixels of its bounds
+      cross = Array.new(12) { |y| Array.new(12) { |x| (3..7).cover?(x) && (x - 3 == y - 3 || x - 3 == 7 - y) } }
+      blobs = described_class.new(mask_pixbuf(cross), 0, 0, 12, 12).find_blobs(5, 5)
+
+      expect(Morandi::RedEye::RED_AREA_DENSITY_THRESHOLD).to eq(0.3)
+      expect(blobs.map { |r| [r.noPixels, r.width, r.height] }).to eq([[9, 5, 5]])
+    end
+  end
+
+  context '.correct_taps' do
+    it 'should correct each tap as labelling its area alone would' do
+      expected = pixbuf.copy
+      [[540, 650], [600, 640]].each { |x, y| correct_one(expected, x, y) }
+
+      expect(described_class.correct_taps(pixbuf, [[540, 650], [600, 640]], options)).to equal(pixbuf)
+      expect(pixbuf.pixels).to eq(expected.pixels)
+    end
+
+    it 'should correct taps one at a time where correcting one eye changes the next' do
+      # A red blob, and two pixels to its right a barely red one that the first one's feathered edge turns grey
+      data = 100.times.flat_map do |y|
+        100.times.flat_map do |x|
+          if x.between?(44, 48) && y.between?(46, 50)
+            [200, 20, 20, 255]
+          elsif x.between?(50, 54) && y.between?(47, 51)
+            [100, 48, 0, 255]
+          else
+            [90, 90, 90, 255]
+          end
+        end
+      end
+      image = GdkPixbuf::Pixbuf.new(data: data.pack('C*'), colorspace: GdkPixbuf::Colorspace::RGB, has_alpha: true,
+                                    bits_per_sample: 8, width: 100, height: 100)
+      taps = [[40, 48], [59, 49]]
+
+      expected = image.copy
+      taps.each { |tap| described_class.correct_taps(expected, [tap], options) }
+      corrected = image.copy
+      described_class.correct_taps(corrected, taps, options)
+
+      expect(corrected.pixels).not_to eq(image.pixels)
+      expect(corrected.pixels).to eq(expected.pixels)
+    end
+
+    it 'should find the same eyes from a proxy scan, checking fewer pixels for red' do
+      expected = pixbuf.copy
+      before = described_class.search_stats
+      described_class.correct_taps(expected, [[540, 650], [600, 640]], options.merge(proxy: 1))
+      full = described_class.search_stats
+      described_class.correct_taps(pixbuf, [[540, 650], [600, 640]], options.merge(proxy: 8))
+      proxy = described_class.search_stats
+
+      expect(pixbuf.pixels).to eq(expected.pixels)
+      full_checks = full[:thresholded] - before[:thresholded]
+      proxy_checks = (proxy[:thresholded] - full[:thresholded]) + (proxy[:sampled] - full[:sampled])
+      expect(full[:sampled] - before[:sampled]).to eq(0)
+      expect(proxy_checks).to be < (full_checks * 2 / 3)
+    end
+
+    it 'should pick a sparser proxy for bigger images in TapRedEye' do
+      small = GdkPixbuf::Pixbuf.new(colorspace: GdkPixbuf::Colorspace::RGB, has_alpha: false, bits_per_sample: 8,
+                                    width: 400, height: 300)
+
+      expect(Morandi::RedEye::TapRedEye.proxy_scale(small)).to eq(1)
+      expect(Morandi::RedEye::TapRedEye.proxy_scale(pixbuf)).to eq(3)
+    end
+
+    [0, -8, 1.5, '8', 2**70].each do |proxy|
+      it "should reject a proxy scale of #{proxy.inspect}" do
+        expect { described_class.correct_taps(pixbuf, [[540, 650]], options.merge(proxy: proxy)) }
+          .to raise_error(ArgumentError)
+      end
+    end
+
+    it 'should ignore taps off the image' do
+      before = pixbuf.pixels
+
+      described_class.correct_taps(pixbuf, [[-1000, 100], [100, pixbuf.height + 1000]], options)
+      expect(pixbuf.pixels).to eq(before)
+    end
+
+    it 'should reject points that are not pairs' do
+      expect { described_class.correct_taps(pixbuf, [[540]], options) }.to raise_error(ArgumentError)
+    end
+  end
+end
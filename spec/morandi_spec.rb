@@ -17,6 +17,9 @@ RSpec.describe Morandi, '#process' do
   let(:processed_image_type) { processed_image_info[0].name }
   let(:processed_image_width) { processed_image_info[1] }
   let(:processed_image_height) { processed_image_info[2] }
+  let(:reference_tolerance) { 0 }
+  let(:straighten_tolerance) { 0 }
+  let(:crop_fill_tolerance) { 0 }
   let(:generate_image) do
     generate_test_image_plasma_checkers(file_in, width: original_image_width, height: original_image_height)
   end
@@ -63,7 +66,8 @@ RSpec.describe Morandi, '#process' do
       it 'creates output' do
         process_image
         expect(File).to exist(file_out)
-        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-no-op-output')
+        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-no-op-output',
+                                                  tolerance: reference_tolerance)
       end
     end
 
@@ -126,7 +130,8 @@ RSpec.describe Morandi, '#process' do
 
         it 'rotates the image' do
           process_image
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-rotated-90')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-rotated-90',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -135,7 +140,8 @@ RSpec.describe Morandi, '#process' do
 
         it 'rotates the image' do
           process_image
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-rotated-180')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-rotated-180',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -144,7 +150,8 @@ RSpec.describe Morandi, '#process' do
 
         it 'rotates the image' do
           process_image
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-rotated-270')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-rotated-270',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -153,7 +160,8 @@ RSpec.describe Morandi, '#process' do
 
         it 'does not perform any rotation' do
           process_image
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-no-op-output')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-no-op-output',
+                                                    tolerance: reference_tolerance)
         end
       end
     end
@@ -172,7 +180,8 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(cropped_width)
           expect(processed_image_height).to eq(cropped_height)
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -186,7 +195,8 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(cropped_width)
           expect(processed_image_height).to eq(cropped_height)
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -200,7 +210,8 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(cropped_width)
           expect(processed_image_height).to eq(cropped_height)
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped-negative-initial-coords')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped-negative-initial-coords',
+                                                    tolerance: crop_fill_tolerance)
         end
       end
 
@@ -214,7 +225,8 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(original_image_width + 50)
           expect(processed_image_height).to eq(original_image_height + 50)
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped-excessive-size')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped-excessive-size',
+                                                    tolerance: crop_fill_tolerance)
         end
       end
 
@@ -228,7 +240,8 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(1)
           expect(processed_image_height).to eq(1)
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped-1x1')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-cropped-1x1',
+                                                    tolerance: reference_tolerance)
         end
       end
     end
@@ -245,7 +258,7 @@ RSpec.describe Morandi, '#process' do
         expect(processed_image_height).to be <= max_size
 
         expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-constrained-output-size',
-                                                  tolerance: 0.006)
+                                                  tolerance: 0.006 + reference_tolerance)
       end
     end
 
@@ -258,7 +271,8 @@ RSpec.describe Morandi, '#process' do
         expect(File).to exist(file_out)
         expect(processed_image_type).to eq('jpeg')
 
-        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-straighten-positive-5')
+        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-straighten-positive-5',
+                                                  tolerance: straighten_tolerance)
       end
 
       context 'with a negative straighten value' do
@@ -270,7 +284,8 @@ RSpec.describe Morandi, '#process' do
           expect(File).to exist(file_out)
           expect(processed_image_type).to eq('jpeg')
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-straighten-negative-20')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-straighten-negative-20',
+                                                    tolerance: straighten_tolerance)
         end
       end
 
@@ -284,7 +299,8 @@ RSpec.describe Morandi, '#process' do
           expect(File).to exist(file_out)
           expect(processed_image_type).to eq('jpeg')
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-straighten-on-vertical-image')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-straighten-on-vertical-image',
+                                                    tolerance: straighten_tolerance)
         end
       end
     end
@@ -298,7 +314,8 @@ RSpec.describe Morandi, '#process' do
         expect(File).to exist(file_out)
         expect(processed_image_type).to eq('jpeg')
 
-        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-gamma')
+        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-gamma',
+                                                  tolerance: reference_tolerance)
       end
     end
 
@@ -313,7 +330,8 @@ RSpec.describe Morandi, '#process' do
 
           expect(File).to exist(file_out)
           expect(processed_image_type).to eq('jpeg')
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-sepia')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-sepia',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -325,7 +343,8 @@ RSpec.describe Morandi, '#process' do
 
           expect(File).to exist(file_out)
           expect(processed_image_type).to eq('jpeg')
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-bluetone')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-bluetone',
+                                                    tolerance: reference_tolerance)
         end
       end
 
@@ -337,7 +356,8 @@ RSpec.describe Morandi, '#process' do
 
           expect(File).to exist(file_out)
           expect(processed_image_type).to eq('jpeg')
-          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-greyscale')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-greyscale',
+                                                    tolerance: reference_tolerance)
         end
       end
     end
@@ -363,7 +383,8 @@ RSpec.describe Morandi, '#process' do
         expect(processed_image_width).to be <= max_width
         expect(processed_image_height).to be <= max_height
 
-        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-auto-cropped', tolerance: 0.0049)
+        expect(file_out).to match_reference_image(reference_image_prefix, 'plasma-auto-cropped',
+                                                  tolerance: 0.0049 + reference_tolerance)
       end
     end
 
@@ -407,7 +428,8 @@ RSpec.describe Morandi, '#process' do
         process_image
 
         reference_image_name = 'pumpkins-icc-adobe-rgb-1998-processed-without-modifications'
-        expect(file_out).to match_reference_image(reference_image_prefix, reference_image_name)
+        expect(file_out).to match_reference_image(reference_image_prefix, reference_image_name,
+                                                  tolerance: reference_tolerance)
       end
     end
 
@@ -458,7 +480,8 @@ RSpec.describe Morandi, '#process' do
 
         expect(File).to exist(file_out)
         expect(processed_image_type).to eq('jpeg')
-        expect(file_out).to match_reference_image(reference_image_prefix, 'match-multiple-operations')
+        expect(file_out).to match_reference_image(reference_image_prefix, 'match-multiple-operations',
+                                                  tolerance: reference_tolerance)
       end
 
       context 'with straighten option' do
@@ -470,7 +493,8 @@ RSpec.describe Morandi, '#process' do
 
           expect(File).to exist(file_out)
           expect(processed_image_type).to eq('jpeg')
-          expect(file_out).to match_reference_image(reference_image_prefix, 'match-multiple-operations-and-straighten')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'match-multiple-operations-and-straighten',
+                                                    tolerance: straighten_tolerance)
         end
       end
     end
@@ -496,7 +520,8 @@ RSpec.describe Morandi, '#process' do
         it 'creates a valid, srgb image' do
           process_image
 
-          expect(file_out).to match_reference_image(reference_image_prefix, 'greyscale-with-sepia')
+          expect(file_out).to match_reference_image(reference_image_prefix, 'greyscale-with-sepia',
+                                                    tolerance: reference_tolerance)
           expect(file_out).to match_colourspace('srgb')
         end
       end
@@ -514,6 +539,17 @@ RSpec.describe Morandi, '#process' do
   end
 
   context 'pixbuf processor' do
+    # JPEGs used to go through jpgicc -q97 before decoding and the references still carry that extra generation of
+    # JPEG loss, measured at 0.001 to 0.003 mean error; colour profiles are now applied to the decoded pixels instead
+    let(:reference_tolerance) { 0.004 }
+    # Straightening is done natively with bilinear sampling, which lands slightly off the Cairo-rendered references
+    let(:straighten_tolerance) { reference_tolerance + 0.005 }
+    # Crops past the image edge are copied exactly by crop_fill; the references came from the slightly blurring
+    # composite with the hyper filter the pixbuf processor used before
+    let(:crop_fill_tolerance) { reference_tolerance + 0.015 }
+    # The native border rasterises its clip edges differently from the Cairo drawing the references were made with
+    let(:border_tolerance) { reference_tolerance + 0.005 }
+
     it_behaves_like 'an image processor', 'pixbuf'
 
     context 'when given a pixbuf as an input' do
@@ -531,6 +567,32 @@ RSpec.describe Morandi, '#process' do
         # Pixbuf's no-op is different than file no-op because icc colour profile processing only happens for files
         expect(file_out).to match_reference_image('plasma-from-pixbuf-no-op-output')
       end
+
+      context 'with colour adjustments and a filter after cropping' do
+        let(:options) { { 'brighten' => 3, 'contrast' => 2, 'crop' => [10, 10, 300, 200], 'fx' => 'sepia' } }
+
+        it 'should not modify the given pixbuf' do
+          original_pixels = pixbuf.pixels
+
+          process_image
+
+          expect(pixbuf.pixels).to eq(original_pixels)
+        end
+      end
+    end
+
+    context 'when given a rotated crop of a JPEG' do
+      let(:options) { { 'angle' => 90, 'sharpen' => 2, 'crop' => [100, 50, 200, 300] } }
+
+      it 'decodes only the part of the image around the crop' do
+        # The crop turned back by 90 degrees, plus the two pixels the sharpen filter reads around it twice over
+        expect(MorandiNative::PixbufUtils).to receive(:load_jpeg_region).with(file_in, 46, 346, 308, 208)
+                                                                        .and_call_original
+        process_image
+
+        expect(processed_image_width).to eq(200)
+        expect(processed_image_height).to eq(300)
+      end
     end
 
     context 'when given a redeye option' do
@@ -548,7 +610,7 @@ RSpec.describe Morandi, '#process' do
         expect(crude_average_colour(GdkPixbuf::Pixbuf.new(file: file_out).subpixbuf(505, 605, 100,
                                                                                     100))).to be_greyish
 
-        expect(file_out).to match_reference_image('redeye-correction')
+        expect(file_out).to match_reference_image('redeye-correction', tolerance: reference_tolerance)
       end
 
       context 'with a gray image and invalid spots' do
@@ -579,7 +641,7 @@ RSpec.describe Morandi, '#process' do
 
         expect(File).to exist(file_out)
         expect(processed_image_type).to eq('jpeg')
-        expect(file_out).to match_reference_image('plasma-blurred')
+        expect(file_out).to match_reference_image('plasma-blurred', tolerance: reference_tolerance)
       end
     end
 
@@ -592,7 +654,8 @@ RSpec.describe Morandi, '#process' do
         expect(File).to exist(file_out)
         expect(processed_image_type).to eq('jpeg')
 
-        expect(file_out).to match_reference_image('plasma-sharpened')
+        # Sharpening amplifies the extra JPEG loss in the reference along with the image
+        expect(file_out).to match_reference_image('plasma-sharpened', tolerance: reference_tolerance * 4)
       end
     end
 
@@ -618,7 +681,7 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(original_image_width)
           expect(processed_image_height).to eq(original_image_height)
 
-          expect(file_out).to match_reference_image('plasma-bordered-black')
+          expect(file_out).to match_reference_image('plasma-bordered-black', tolerance: border_tolerance)
         end
       end
 
@@ -633,7 +696,7 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(original_image_width)
           expect(processed_image_height).to eq(original_image_height)
 
-          expect(file_out).to match_reference_image('plasma-bordered-white')
+          expect(file_out).to match_reference_image('plasma-bordered-white', tolerance: border_tolerance)
         end
       end
 
@@ -648,7 +711,7 @@ RSpec.describe Morandi, '#process' do
           expect(processed_image_width).to eq(original_image_width)
           expect(processed_image_height).to eq(original_image_height)
 
-          expect(file_out).to match_reference_image('plasma-bordered-retro-background')
+          expect(file_out).to match_reference_image('plasma-bordered-retro-background', tolerance: border_tolerance)
         end
       end
     end
@@ -672,7 +735,7 @@ RSpec.describe Morandi, '#process' do
         expect(processed_image_width).to eq(original_image_width)
         expect(processed_image_height).to eq(original_image_height)
 
-        expect(file_out).to match_reference_image('plasma-bordered-retro-style')
+        expect(file_out).to match_reference_image('plasma-bordered-retro-style', tolerance: border_tolerance)
       end
     end
 
@@ -703,7 +766,7 @@ RSpec.describe Morandi, '#process' do
         expect(processed_image_width).to eq(desired_image_width)
         expect(processed_image_height).to eq(desired_image_height)
 
-        expect(file_out).to match_reference_image('plasma-multiple-transformations')
+        expect(file_out).to match_reference_image('plasma-multiple-transformations', tolerance: reference_tolerance)
       end
     end
   end
@@ -739,5 +802,20 @@ RSpec.describe Morandi, '#process' do
         end
       end
     end
+
+    context 'when given an output.max well below the size of a JPEG' do
+      let(:options) { { 'output.max' => 200, 'crop' => '80,65,640,520' } }
+      let(:original_image_width) { 1600 }
+      let(:original_image_height) { 1300 }
+
+      it 'decodes it at a fraction of the size and resizes the rest of the way' do
+        allow(Vips::Image).to receive(:new_from_file).and_call_original
+        expect(Vips::Image).to receive(:new_from_file).with(file_in, shrink: 4).and_call_original
+        process_image
+
+        expect(processed_image_width).to eq(80)
+        expect(processed_image_height).to eq(65)
+      end
+    end
   end
 end